@@ -0,0 +1,295 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <vector>
+
+#include "block.hpp"
+#include "cfg.hpp"
+#include "chip8.hpp"
+#include "instruction.hpp"
+#include "utils.hpp"
+
+#include "aot.hpp"
+
+namespace c8::aot {
+
+using ins::Kind;
+
+namespace {
+
+std::vector<Image> &registry() {
+    static std::vector<Image> images;
+    return images;
+}
+
+// Ignore the zero padding ROM loading leaves behind
+std::size_t trimmed_size(const std::uint8_t *program, std::size_t size) {
+    while (size && !program[size - 1])
+        --size;
+    return size;
+}
+
+const char *handler_name(Kind kind) {
+    switch (kind) {
+#define X(kind, fn) case Kind::kind: return STRINGIFY(fn);
+        C8_KINDS(X)
+#undef X
+        default: return "unknown";
+    }
+}
+
+void emit_body(std::FILE *fp, Kind kind, ins::Opcode op) {
+    auto x = op.x(), y = op.y();
+    switch (kind) {
+        case Kind::Sys:
+            std::fprintf(fp, "    // Deprecated\n");
+            break;
+        case Kind::LdImm:
+            std::fprintf(fp, "    r[0x%x] = 0x%02x;\n", x, op.byte());
+            break;
+        case Kind::LdReg:
+            std::fprintf(fp, "    r[0x%x] = r[0x%x];\n", x, y);
+            break;
+        case Kind::AddImm:
+            std::fprintf(fp, "    r[0x%x] += 0x%02x;\n", x, op.byte());
+            break;
+        case Kind::Or:
+            std::fprintf(fp, "    r[0x%x] |= r[0x%x];\n", x, y);
+            break;
+        case Kind::And:
+            std::fprintf(fp, "    r[0x%x] &= r[0x%x];\n", x, y);
+            break;
+        case Kind::Xor:
+            std::fprintf(fp, "    r[0x%x] ^= r[0x%x];\n", x, y);
+            break;
+        case Kind::AddReg:
+            std::fprintf(fp, "    r.Vf = (r[0x%x] + r[0x%x]) > 0xff;\n", x, y);
+            std::fprintf(fp, "    r[0x%x] = r[0x%x] + r[0x%x];\n", x, x, y);
+            break;
+        case Kind::Sub:
+            std::fprintf(fp, "    r.Vf = r[0x%x] > r[0x%x];\n", x, y);
+            std::fprintf(fp, "    r[0x%x] -= r[0x%x];\n", x, y);
+            break;
+        case Kind::Subn:
+            std::fprintf(fp, "    r.Vf = r[0x%x] > r[0x%x];\n", y, x);
+            std::fprintf(fp, "    r[0x%x] = r[0x%x] - r[0x%x];\n", x, y, x);
+            break;
+        case Kind::Shr:
+            std::fprintf(fp, "    r.Vf = r[0x%x] & 1;\n", x);
+            std::fprintf(fp, "    r[0x%x] >>= 1;\n", x);
+            break;
+        case Kind::Shl:
+            std::fprintf(fp, "    r.Vf = (r[0x%x] >> 7) & 1;\n", x);
+            std::fprintf(fp, "    r[0x%x] <<= 1;\n", x);
+            break;
+        case Kind::LdI:
+            std::fprintf(fp, "    r.I = 0x%03x;\n", op.addr());
+            break;
+        case Kind::AddI:
+            std::fprintf(fp, "    r.I += r[0x%x];\n", x);
+            break;
+        case Kind::LdFont:
+            std::fprintf(fp, "    r.I = r[0x%x] * 5;\n", x);
+            break;
+        case Kind::LdDt:
+            std::fprintf(fp, "    r[0x%x] = r.DT;\n", x);
+            break;
+        case Kind::SetDt:
+            std::fprintf(fp, "    r.DT = r[0x%x];\n", x);
+            break;
+        case Kind::SetSt:
+            std::fprintf(fp, "    r.ST = r[0x%x];\n", x);
+            break;
+        default:
+            std::fprintf(fp, "    impl::%s(c, Opcode(0x%04x));\n", handler_name(kind), static_cast<std::uint16_t>(op));
+            break;
+    }
+}
+
+void emit_exit(std::FILE *fp, const std::uint8_t *mem, const cfg::Node &node) {
+    auto op = cfg::read(mem, node.exit_pc);
+    auto x = op.x(), y = op.y();
+    auto n = node.length;
+
+    // Both paths of a skip, the taken one first
+    auto skip = [&](const char *cond) {
+        std::fprintf(fp, "    if (%s) {\n", cond);
+        std::fprintf(fp, "        r.PC = 0x%03x;\n", node.exit_pc + 4);
+        std::fprintf(fp, "        return %u;\n", n + 1);
+        std::fprintf(fp, "    }\n");
+        if (node.fused) {
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", cfg::read(mem, node.exit_pc + 2).addr());
+            std::fprintf(fp, "    return %u;\n", n + 2);
+        } else {
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", node.exit_pc + 2);
+            std::fprintf(fp, "    return %u;\n", n + 1);
+        }
+    };
+
+    char cond[64];
+    switch (node.exit) {
+        case Kind::Unknown:
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", node.exit_pc);
+            std::fprintf(fp, "    return %u;\n", n);
+            break;
+        case Kind::Jp:
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", op.addr());
+            std::fprintf(fp, "    return %u;\n", n + 1);
+            break;
+        case Kind::SeImm:
+        case Kind::SneImm:
+            std::snprintf(cond, sizeof(cond), "r[0x%x] %s 0x%02x", x,
+                (node.exit == Kind::SeImm) ? "==" : "!=", op.byte());
+            skip(cond);
+            break;
+        case Kind::SeReg:
+        case Kind::SneReg:
+            std::snprintf(cond, sizeof(cond), "r[0x%x] %s r[0x%x]", x,
+                (node.exit == Kind::SeReg) ? "==" : "!=", y);
+            skip(cond);
+            break;
+        case Kind::Skp:
+        case Kind::Sknp:
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", node.exit_pc);
+            std::fprintf(fp, "    impl::%s(c, Opcode(0x%04x));\n", handler_name(node.exit), static_cast<std::uint16_t>(op));
+            std::snprintf(cond, sizeof(cond), "r.PC != 0x%03x", node.exit_pc);
+            skip(cond);
+            break;
+        default:
+            std::fprintf(fp, "    r.PC = 0x%03x;\n", node.exit_pc);
+            std::fprintf(fp, "    impl::%s(c, Opcode(0x%04x));\n", handler_name(node.exit), static_cast<std::uint16_t>(op));
+            std::fprintf(fp, "    r.PC += 2;\n");
+            std::fprintf(fp, "    return %u;\n", n + 1);
+            break;
+    }
+}
+
+// Quoted C string literal, safe in comments too since it spans a single line
+void write_string(std::FILE *fp, const std::string &str) {
+    std::fputc('"', fp);
+    for (unsigned char chr: str) {
+        if ((chr == '"') || (chr == '\\'))
+            std::fprintf(fp, "\\%c", chr);
+        else if ((chr < 0x20) || (chr >= 0x7f))
+            std::fprintf(fp, "\\%03o", chr);
+        else
+            std::fputc(chr, fp);
+    }
+    std::fputc('"', fp);
+}
+
+} // namespace
+
+Registration::Registration(const Image &image) {
+    registry().push_back(image);
+}
+
+const Image *find(const std::uint8_t *program, std::size_t size) {
+    size = trimmed_size(program, size);
+    for (auto &image: registry()) {
+        if ((image.size == size) && !std::memcmp(image.program, program, size))
+            return &image;
+    }
+    return nullptr;
+}
+
+bool generate(std::FILE *fp, const std::uint8_t *mem, std::size_t size, const std::string &name) {
+    auto *program = mem + ProgramStart;
+    size = trimmed_size(program, std::min<std::size_t>(size, AddressSpaceEnd - ProgramStart));
+
+    auto graph = cfg::build(mem, ProgramStart);
+
+    std::fputs("// Generated by c8 from ", fp);
+    write_string(fp, name);
+    std::fputs(", do not edit\n\n", fp);
+    std::fprintf(fp, "#include \"aot.hpp\"\n#include \"chip8.hpp\"\n#include \"instruction.hpp\"\n\n");
+    std::fprintf(fp, "namespace {\n\n");
+    std::fprintf(fp, "using c8::Chip8;\nusing c8::ins::Opcode;\nnamespace impl = c8::ins::impl;\n\n");
+
+    std::fprintf(fp, "const std::uint8_t program[] = {");
+    for (std::size_t i = 0; i < size; ++i)
+        std::fprintf(fp, "%s0x%02x,", (i % 16) ? " " : "\n    ", program[i]);
+    std::fprintf(fp, "\n};\n\n");
+
+    for (auto &[start, node]: graph) {
+        std::fprintf(fp, "std::uint32_t block_%03x(Chip8 &c) {\n", start);
+        std::fprintf(fp, "    [[maybe_unused]] auto &r = c.regs;\n");
+        for (Address addr = start, i = 0; i < node.length; ++i, addr += sizeof(ins::Opcode)) {
+            auto op = cfg::read(mem, addr);
+            emit_body(fp, ins::decode(op), op);
+        }
+        emit_exit(fp, mem, node);
+        std::fprintf(fp, "}\n\n");
+    }
+
+    std::fprintf(fp, "const c8::aot::Entry entries[] = {\n");
+    for (auto &[start, node]: graph)
+        std::fprintf(fp, "    { 0x%03x, 0x%03x, block_%03x },\n", start, node.end, start);
+    std::fprintf(fp, "};\n\n");
+
+    std::fprintf(fp, "const c8::aot::Registration registration({\n");
+    std::fputs("    ", fp);
+    write_string(fp, name);
+    std::fputs(", program, sizeof(program), entries, sizeof(entries) / sizeof(*entries),\n", fp);
+    std::fprintf(fp, "});\n\n");
+    std::fprintf(fp, "} // namespace\n");
+
+    return !std::ferror(fp);
+}
+
+Runtime::Runtime(const Image &image): image(image) {
+    this->populate();
+}
+
+void Runtime::populate() noexcept {
+    this->entries.fill(nullptr);
+    this->code.reset();
+    for (std::size_t i = 0; i < this->image.count; ++i) {
+        auto &entry = this->image.entries[i];
+        this->entries[entry.start] = &entry;
+        for (Address addr = entry.start; addr < entry.end; ++addr)
+            this->code[addr] = true;
+    }
+}
+
+void Runtime::reset(const std::uint8_t *mem) noexcept {
+    this->populate();
+
+    // Bytes past the image were zero padding, below ProgramStart nothing is known
+    for (Address addr = 0; addr < this->code.size(); ++addr) {
+        if (!this->code[addr])
+            continue;
+        std::size_t offset = addr - ProgramStart;
+        if ((addr < ProgramStart) || (mem[addr] != ((offset < this->image.size) ? this->image.program[offset] : 0)))
+            this->invalidate(addr);
+    }
+}
+
+void Runtime::invalidate(Address addr) noexcept {
+    if (!this->code[addr])
+        return;
+
+    // Same bound as blk::BlockCache::invalidate
+    constexpr int max_size = (blk::Block::max_length + 2) * sizeof(ins::Opcode);
+    for (int start = addr; (start >= 0) && (start > addr - max_size); --start) {
+        if (this->entries[start] && (addr < this->entries[start]->end))
+            this->entries[start] = nullptr;
+    }
+}
+
+} // namespace c8::aot
@@ -0,0 +1,94 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <array>
+#include <bitset>
+#include <string>
+
+namespace c8 {
+
+class Chip8;
+
+using Address = std::uint16_t;
+
+} // namespace c8
+
+namespace c8::aot {
+
+// Precompiled block, same contract as blk::BlockCache::execute
+using Function = std::uint32_t (*)(Chip8 &chip);
+
+struct Entry {
+    Address  start, end;
+    Function fn;
+
+    // Upper bound on the instructions one call retires
+    constexpr std::uint32_t size() const noexcept {
+        return (this->end - this->start) / 2;
+    }
+};
+
+// Everything a generated translation unit provides
+struct Image {
+    const char         *name;
+    const std::uint8_t *program; // Bytes the image was compiled from
+    std::size_t         size;
+    const Entry        *entries;
+    std::size_t         count;
+};
+
+// Generated translation units hold one of these to make their image known
+struct Registration {
+    Registration(const Image &image);
+};
+
+// Image compiled from exactly these program bytes, if one was linked in
+const Image *find(const std::uint8_t *program, std::size_t size);
+
+// Writes a translation unit compiling every block reachable from ProgramStart
+bool generate(std::FILE *fp, const std::uint8_t *mem, std::size_t size, const std::string &name);
+
+// Per-machine view of an image, entries are dropped once their code gets written to
+class Runtime {
+    public:
+        Runtime(const Image &image);
+
+        inline const Entry *lookup(Address addr) const noexcept {
+            return (addr < this->entries.size()) ? this->entries[addr] : nullptr;
+        }
+
+        void invalidate(Address addr) noexcept;
+
+        // Starts over from the image, keeping only the entries whose code matches mem
+        void reset(const std::uint8_t *mem) noexcept;
+
+    protected:
+        void populate() noexcept;
+
+    protected:
+        const Image &image;
+
+        std::array<const Entry *, 0x1000> entries{};
+        std::bitset<0x1000>               code;
+};
+
+} // namespace c8::aot
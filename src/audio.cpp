@@ -0,0 +1,84 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <cstdlib>
+#include <SDL.h>
+
+#include "utils.hpp"
+
+#include "audio.hpp"
+
+namespace c8::audio {
+
+namespace {
+
+int sample_nr;
+
+} // namespace
+
+Sdl::Sdl() {
+#ifdef __MINGW32__
+    putenv("SDL_AUDIODRIVER=DirectSound");
+#endif
+
+    if (auto rc = SDL_InitSubSystem(SDL_INIT_AUDIO); rc != 0) {
+        ERROR("Failed to init audio: %#x - %s\n", rc, SDL_GetError());
+        return;
+    }
+
+    SDL_AudioSpec want, spec;
+    want.freq     = 44100;
+    want.format   = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples  = 2048;
+    want.userdata = nullptr;
+    want.callback = +[](void *userdata, std::uint8_t *data, int length) {
+        UNUSED(userdata);
+        for (int i = 0; i < length / 2; ++i, ++sample_nr) {
+            float time = static_cast<float>(sample_nr) / 44100.0f;
+            reinterpret_cast<std::int16_t *>(data)[i] = 28000.0f * std::sin(2.0f * M_PI * 441.0f * time);
+        }
+    };
+
+    if (SDL_OpenAudio(&want, &spec) != 0) {
+        ERROR("Failed to open audio device: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return;
+    }
+
+    this->initialized = true;
+}
+
+Sdl::~Sdl() {
+    if (!this->initialized)
+        return;
+
+    SDL_CloseAudio();
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+void Sdl::beep(bool on) {
+    if (!this->initialized || (on == this->playing))
+        return;
+
+    SDL_PauseAudio(!on);
+    this->playing = on;
+}
+
+} // namespace c8::audio
@@ -15,80 +15,34 @@
 // You should have received a copy of the GNU General Public License
 // along with c8.  If not, see <http://www.gnu.org/licenses/>.
 
-#pragma once
 
-#include <cstdint>
-#include <cmath>
-#include <atomic>
-#include <thread>
-#include <SDL.h>
+#pragma once
 
-#include "chip8.hpp"
 #include "utils.hpp"
 
 namespace c8::audio {
 
-using namespace std::chrono_literals;
-
-namespace impl {
-
-inline int sample_nr;
-inline SDL_AudioDeviceID dev;
-inline SDL_AudioSpec     spec;
-inline std::thread      audio_thread;
-inline std::atomic_bool audio_thread_should_stop = false;
-
-} // namespace impl
-
-int initialize(std::uint8_t &sound_timer) {
-#ifdef __MINGW32__
-    putenv("SDL_AUDIODRIVER=DirectSound");
-#endif
-
-    if (auto rc = SDL_InitSubSystem(SDL_INIT_AUDIO); rc != 0) {
-        ERROR("Failed to init audio: %#x - %s\n", rc, SDL_GetError());
-        return rc;
-    }
-
-    SDL_AudioSpec want;
-    want.freq     = 44100;
-    want.format   = AUDIO_S16SYS;
-    want.channels = 1;
-    want.samples  = 2048;
-    want.userdata = nullptr;
-    want.callback = +[](void *userdata, std::uint8_t *data, int length) {
-        UNUSED(userdata);
-        for (int i = 0; i < length / 2; ++i, ++impl::sample_nr) {
-            float time = static_cast<float>(impl::sample_nr) / 44100.0f;
-            reinterpret_cast<std::int16_t *>(data)[i] = 28000.0f * std::sin(2.0f * M_PI * 441.0f * time);
-        }
-    };
+// Sound output
+class Audio {
+    public:
+        virtual ~Audio() = default;
 
-    if (SDL_OpenAudio(&want, &impl::spec) != 0) {
-        ERROR("Failed to open audio device: %s\n", SDL_GetError());
-        return 1;
-    }
+        // Called on every timer tick with whether the sound timer is running
+        virtual void beep(bool on) { UNUSED(on); }
+};
 
-    impl::audio_thread = std::thread([&sound_timer] {
-        while (!impl::audio_thread_should_stop) {
-            if (sound_timer) {
-                SDL_PauseAudio(0);
-                std::this_thread::sleep_for(sound_timer * timer_rate);
-                SDL_PauseAudio(1);
-            }
-            std::this_thread::sleep_for(1ms);
-        }
-    });
+class Silent: public Audio { };
 
-    return 0;
-}
+// Beeps through SDL while the sound timer is running
+class Sdl: public Audio {
+    public:
+        Sdl();
+        ~Sdl();
 
-void finalize() {
-    impl::audio_thread_should_stop = true;
-    impl::audio_thread.join();
+        void beep(bool on) override;
 
-    SDL_CloseAudio();
-    SDL_QuitSubSystem(SDL_INIT_AUDIO);
-}
+    private:
+        bool initialized = false, playing = false;
+};
 
 } // namespace c8::audio
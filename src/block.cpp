@@ -0,0 +1,229 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "chip8.hpp"
+#include "instruction.hpp"
+#include "jit.hpp"
+
+#include "block.hpp"
+
+namespace c8::blk {
+
+namespace {
+
+using ins::Kind;
+
+template <Kind K>
+void single(Chip8 &c, const Uop &u) {
+    ins::handler(K)(c, u.op);
+}
+
+template <Kind K>
+std::uint8_t single_exit(Chip8 &c, const Uop &u) {
+    ins::handler(K)(c, u.op);
+    return 1;
+}
+
+// Se/Sne/Skp/Sknp; Jp nnn
+template <Kind K>
+std::uint8_t skip_jp(Chip8 &c, const Uop &u) {
+    auto pc = c.regs.PC;
+    ins::handler(K)(c, u.op);
+    if (c.regs.PC != pc)
+        return 1;
+    c.regs.PC = u.op2.addr() - 2;
+    return 2;
+}
+
+constexpr std::array<BodyHandler, static_cast<std::size_t>(Kind::Count)> bodies = {
+#define X(kind, fn) single<Kind::kind>,
+    C8_KINDS(X)
+#undef X
+};
+
+constexpr std::array<ExitHandler, static_cast<std::size_t>(Kind::Count)> exits = {
+#define X(kind, fn) single_exit<Kind::kind>,
+    C8_KINDS(X)
+#undef X
+};
+
+constexpr inline BodyHandler body_handler(Kind kind) {
+    return bodies[static_cast<std::size_t>(kind)];
+}
+
+constexpr inline ExitHandler exit_handler(Kind kind) {
+    return exits[static_cast<std::size_t>(kind)];
+}
+
+ExitHandler skip_jp_handler(Kind kind) {
+    switch (kind) {
+        case Kind::SeImm:  return skip_jp<Kind::SeImm>;
+        case Kind::SeReg:  return skip_jp<Kind::SeReg>;
+        case Kind::SneImm: return skip_jp<Kind::SneImm>;
+        case Kind::SneReg: return skip_jp<Kind::SneReg>;
+        case Kind::Skp:    return skip_jp<Kind::Skp>;
+        case Kind::Sknp:   return skip_jp<Kind::Sknp>;
+        default:           return nullptr;
+    }
+}
+
+} // namespace
+
+bool BlockCache::ends_block(Kind kind) noexcept {
+    switch (kind) {
+        case Kind::Ret:
+        case Kind::Jp:
+        case Kind::JpV0:
+        case Kind::Call:
+        case Kind::SeImm:
+        case Kind::SeReg:
+        case Kind::SneImm:
+        case Kind::SneReg:
+        case Kind::Skp:
+        case Kind::Sknp:
+        case Kind::LdKey:
+        case Kind::LdBcd:
+        case Kind::LdStore:
+            return true;
+        default:
+            return false;
+    }
+}
+
+BlockCache::BlockCache(std::unique_ptr<jit::Compiler> &&jit): jit(std::move(jit)) { }
+
+BlockCache::~BlockCache() = default;
+
+Block *BlockCache::lookup(Chip8 &chip, Address addr) {
+    // Blocks never wrap around the address space
+    if (addr > AddressSpaceEnd - sizeof(ins::Opcode))
+        return nullptr;
+
+    auto &block = this->blocks[addr];
+    if (!block)
+        block = this->build(chip, addr);
+    return block.get();
+}
+
+std::size_t BlockCache::execute(Chip8 &chip, Block &block) {
+    if (block.native)
+        return block.native(&chip, &chip.regs);
+
+    if (this->jit && (++block.hits == hot_threshold) && (this->invalidations[block.start] < max_invalidations)) {
+        if (block.native = this->translate(chip, block); block.native)
+            return block.native(&chip, &chip.regs);
+    }
+
+    for (auto &uop: block.body)
+        uop.body(chip, uop);
+
+    chip.regs.PC = block.exit_pc;
+    if (!block.exit.exit)
+        return block.length;
+
+    // The exit may store into this block and invalidate it, copy what is needed
+    auto exit = block.exit;
+    std::size_t retired = block.length;
+    retired += exit.exit(chip, exit);
+    chip.regs.PC += 2;
+    return retired;
+}
+
+void BlockCache::invalidate(Address addr) noexcept {
+    if (!this->code[addr])
+        return;
+
+    // Body plus a fused skip/jump exit
+    constexpr int max_size = (Block::max_length + 2) * sizeof(ins::Opcode);
+    for (int start = addr; (start >= 0) && (start > addr - max_size); --start) {
+        auto &block = this->blocks[start];
+        if (block && (addr < block->end)) {
+            block.reset();
+            this->invalidations[start] += this->invalidations[start] < UINT8_MAX;
+        }
+    }
+}
+
+void BlockCache::clear() noexcept {
+    for (auto &block: this->blocks)
+        block.reset();
+    this->code.reset();
+    this->invalidations.fill(0);
+    if (this->jit)
+        this->jit->flush();
+}
+
+Native BlockCache::translate(Chip8 &chip, const Block &block) {
+    if (auto native = this->jit->compile(chip, block); native || !this->jit->is_full())
+        return native;
+
+    // Out of code space, drop every translation and start over
+    this->jit->flush();
+    for (auto &b: this->blocks) {
+        if (b)
+            b->native = nullptr, b->hits = 0;
+    }
+    return this->jit->compile(chip, block);
+}
+
+std::unique_ptr<Block> BlockCache::build(Chip8 &chip, Address start) {
+    auto block = std::make_unique<Block>();
+    block->start = start;
+
+    Address addr = start;
+    while ((block->length < Block::max_length) && (addr <= AddressSpaceEnd - sizeof(ins::Opcode))) {
+        auto [op, kind, valid] = chip.fetch(addr);
+        UNUSED(valid);
+
+        if (ends_block(kind)) {
+            block->exit_pc = addr;
+            block->exit.op = op;
+
+            // Fuse conditional skips with a following jump, typical of loops
+            auto next = static_cast<Address>(addr + sizeof(ins::Opcode));
+            if (ins::is_skip(kind) && (next <= AddressSpaceEnd - sizeof(ins::Opcode))
+                    && (chip.fetch(next).kind == Kind::Jp)) {
+                block->exit.exit = skip_jp_handler(kind);
+                block->exit.op2  = chip.fetch(next).op;
+                addr            += 2 * sizeof(ins::Opcode);
+            } else {
+                block->exit.exit = exit_handler(kind);
+                addr            += sizeof(ins::Opcode);
+            }
+            break;
+        }
+
+        Uop uop{};
+        uop.body = body_handler(kind);
+        uop.op   = op;
+        block->body.push_back(uop);
+
+        block->length += 1;
+        addr          += sizeof(ins::Opcode);
+    }
+
+    if (!block->exit.exit)
+        block->exit_pc = addr;
+    block->end = addr;
+
+    for (Address i = start; i < block->end; ++i)
+        this->code[i] = true;
+
+    return block;
+}
+
+} // namespace c8::blk
@@ -0,0 +1,120 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include "instruction.hpp"
+
+namespace c8 {
+
+class Chip8;
+struct Registers;
+
+using Address = std::uint16_t;
+
+} // namespace c8
+
+namespace c8::jit {
+
+class Compiler;
+
+} // namespace c8::jit
+
+namespace c8::blk {
+
+struct Uop;
+
+// Body handlers never touch PC, exit handlers run with PC pointing at the exit
+// instruction and return the number of instructions they retired
+using BodyHandler = void         (*)(Chip8 &chip, const Uop &uop);
+using ExitHandler = std::uint8_t (*)(Chip8 &chip, const Uop &uop);
+
+// Translated block, same contract as BlockCache::execute
+using Native      = std::uint32_t (*)(Chip8 *chip, Registers *regs);
+
+// One instruction, or a conditional skip fused with the jump it skips
+struct Uop {
+    union {
+        BodyHandler body;
+        ExitHandler exit;
+    };
+    ins::Opcode op, op2;
+};
+
+// Straight-line code, ending at the first instruction that reads/writes PC or stores to ram
+struct Block {
+    std::vector<Uop> body;
+    Uop              exit{};       // exit.exit is null when the block was cut short
+    Address          exit_pc = 0;  // Address of the exit instruction, or of the following code
+    Address          start = 0, end = 0;
+    std::uint16_t    length = 0;   // Instructions in the body, the exit reports its own
+
+    std::uint32_t    hits   = 0;
+    Native           native = nullptr;
+
+    constexpr static std::uint16_t max_length = 32;
+
+    // Upper bound on the instructions one execution retires
+    inline std::uint32_t size() const noexcept {
+        return (this->end - this->start) / sizeof(ins::Opcode);
+    }
+};
+
+class BlockCache {
+    public:
+        // Hot blocks get translated to native code when a compiler is given
+        BlockCache(std::unique_ptr<jit::Compiler> &&jit = nullptr);
+        ~BlockCache();
+
+        // Returns null when no block can start at this address
+        Block *lookup(Chip8 &chip, Address addr);
+
+        // Executes the block at PC, returns the number of instructions retired
+        std::size_t execute(Chip8 &chip, Block &block);
+
+        // Drops every block covering this byte
+        void invalidate(Address addr) noexcept;
+
+        // Drops every block and translation
+        void clear() noexcept;
+
+        static bool ends_block(ins::Kind kind) noexcept;
+
+        // Executions before a block gets translated
+        constexpr static std::uint32_t hot_threshold = 8;
+
+        // Blocks invalidated this many times modify themselves, they stay interpreted
+        constexpr static std::uint8_t max_invalidations = 2;
+
+    protected:
+        std::unique_ptr<Block> build(Chip8 &chip, Address start);
+        Native translate(Chip8 &chip, const Block &block);
+
+    protected:
+        std::unique_ptr<jit::Compiler>             jit;
+        std::array<std::unique_ptr<Block>, 0x1000> blocks;
+        std::bitset<0x1000>                        code; // Bytes covered by any block, only reset by clear
+        std::array<std::uint8_t, 0x1000>           invalidations{}; // Per start address, saturating
+};
+
+} // namespace c8::blk
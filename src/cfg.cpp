@@ -0,0 +1,111 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "block.hpp"
+#include "chip8.hpp"
+#include "instruction.hpp"
+
+#include "cfg.hpp"
+
+namespace c8::cfg {
+
+using ins::Kind;
+
+namespace {
+
+constexpr Address last_address = AddressSpaceEnd - sizeof(ins::Opcode);
+
+void link(const std::uint8_t *mem, Node &node) {
+    auto op = read(mem, node.exit_pc);
+    auto &succ = node.successors;
+    switch (node.exit) {
+        case Kind::Unknown:
+            succ.push_back(node.end);
+            break;
+        case Kind::Jp:
+            succ.push_back(op.addr());
+            break;
+        case Kind::Call:
+            succ.push_back(op.addr());
+            succ.push_back(node.exit_pc + 2);
+            break;
+        case Kind::Ret:
+        case Kind::JpV0:
+            break;
+        case Kind::LdKey:
+        case Kind::LdBcd:
+        case Kind::LdStore:
+            succ.push_back(node.exit_pc + 2);
+            break;
+        default:
+            if (node.fused)
+                succ.push_back(read(mem, node.exit_pc + 2).addr());
+            else
+                succ.push_back(node.exit_pc + 2);
+            succ.push_back(node.exit_pc + 4);
+            break;
+    }
+}
+
+} // namespace
+
+ins::Opcode read(const std::uint8_t *mem, Address addr) noexcept {
+    return ins::Opcode(mem[addr & address_mask] << 8 | mem[(addr + 1) & address_mask]);
+}
+
+Graph build(const std::uint8_t *mem, Address entry) {
+    Graph graph;
+    std::vector<Address> pending = { entry };
+
+    while (!pending.empty()) {
+        auto start = pending.back();
+        pending.pop_back();
+        if ((start > last_address) || graph.count(start))
+            continue;
+
+        auto &node = graph[start];
+        node.start = start;
+
+        // Mirrors blk::BlockCache::build
+        Address addr = start;
+        while ((node.length < blk::Block::max_length) && (addr <= last_address)) {
+            auto kind = ins::decode(read(mem, addr));
+            if (blk::BlockCache::ends_block(kind)) {
+                node.exit    = kind;
+                node.exit_pc = addr;
+                node.fused   = ins::is_skip(kind) && (addr + sizeof(ins::Opcode) <= last_address)
+                    && (ins::decode(read(mem, addr + sizeof(ins::Opcode))) == Kind::Jp);
+                addr += (node.fused ? 2 : 1) * sizeof(ins::Opcode);
+                break;
+            }
+
+            ++node.length;
+            addr += sizeof(ins::Opcode);
+        }
+
+        if (node.exit == Kind::Unknown)
+            node.exit_pc = addr;
+        node.end = addr;
+
+        link(mem, node);
+        pending.insert(pending.end(), node.successors.begin(), node.successors.end());
+    }
+
+    return graph;
+}
+
+} // namespace c8::cfg
@@ -0,0 +1,53 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "instruction.hpp"
+
+namespace c8 {
+
+using Address = std::uint16_t;
+
+} // namespace c8
+
+namespace c8::cfg {
+
+// Same extent as the runtime block starting at this address
+struct Node {
+    Address       start = 0, end = 0;
+    Address       exit_pc = 0;              // Address of the exit instruction, or of the following code
+    ins::Kind     exit = ins::Kind::Unknown; // Unknown when the block was cut short
+    bool          fused = false;            // Exit is a conditional skip followed by 1nnn
+    std::uint16_t length = 0;               // Instructions before the exit
+
+    std::vector<Address> successors;        // Statically known ones only
+};
+
+using Graph = std::map<Address, Node>;
+
+// Decodes the big-endian instruction at addr from a full 4 KiB memory image
+ins::Opcode read(const std::uint8_t *mem, Address addr) noexcept;
+
+// Walks every block reachable from entry, following jumps, calls, returns and skips
+Graph build(const std::uint8_t *mem, Address entry);
+
+} // namespace c8::cfg
@@ -17,10 +17,18 @@
 
 #include <array>
 #include <algorithm>
-#include <experimental/random>
+#include <cstring>
+#include <random>
 
 #include "audio.hpp"
 #include "instruction.hpp"
+#include "jit.hpp"
+#include "profiler.hpp"
+#include "rewind.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "terminal.hpp"
+#include "utils.hpp"
 #include "window.hpp"
 
 #include "chip8.hpp"
@@ -29,6 +37,9 @@ using namespace std::chrono_literals;
 
 namespace c8 {
 
+template class mem::Paged<Decoded, AddressSpaceEnd>;
+template class mem::Paged<std::uint8_t, AddressSpaceEnd>;
+
 namespace {
 
 constexpr inline std::array glyphs = {
@@ -52,156 +63,375 @@ constexpr inline std::array glyphs = {
 
 } // namespace
 
-Chip8::Chip8(const std::shared_ptr<rom::Program> &program) {
+Chip8::Chip8(const std::shared_ptr<const rom::Program> &program, Mode mode, bool headless, std::uint32_t ipf):
+        scheduler(ipf, !headless), mode(mode) {
     constexpr auto available = AddressSpaceEnd - ProgramStart;
     if (program->size() > available)
         ERROR("Program too large to fit in memory\n");
 
-    // Seed random number generator
-    std::experimental::reseed();
+    this->seed(std::random_device()());
 
-    // Set up glyph data
-    std::copy(glyphs.begin(), glyphs.end(),
-        reinterpret_cast<decltype(glyphs)::value_type *>(this->ram.begin()));
+    if (headless)
+        this->window = std::make_unique<win::Headless>();
+    else
+        this->window = std::make_unique<win::Terminal>();
 
-    // Set up program in address space
+    // Pages left blank by the program stay shared with every other machine
+    Chip8::load(this->ram, *program);
     this->regs.PC = ProgramStart;
-    std::copy(program->begin(), program->end(),
-        reinterpret_cast<ins::Opcode *>(this->ram.begin() + ProgramStart));
-
-    this->timer_thread = std::thread([this]() {
-        while (!this->timer_thread_should_stop) {
-            std::this_thread::sleep_for(timer_rate);
-            if (!this->window.should_pause && this->regs.DT)
-                --this->regs.DT;
-            if (!this->window.should_pause && this->regs.ST)
-                --this->regs.ST;
+
+    if ((this->mode == Mode::Jit) && !jit::available) {
+        ERROR("Jit unsupported on this host, falling back to blocks\n");
+        this->mode = Mode::Block;
+    }
+
+    if (this->mode == Mode::Aot) {
+        auto *image = aot::find(program->data(), std::min<std::size_t>(program->size(), available));
+        if (image) {
+            this->aot = std::make_unique<aot::Runtime>(*image);
+        } else {
+            ERROR("No precompiled image matches this program, falling back to the interpreter\n");
+            this->mode = Mode::Interpreter;
         }
-    });
+    }
+
+    if (this->mode == Mode::Block)
+        this->blocks = std::make_unique<blk::BlockCache>();
+    else if (this->mode == Mode::Jit)
+        this->blocks = std::make_unique<blk::BlockCache>(std::make_unique<jit::Compiler>());
+
+    if (headless)
+        this->audio = std::make_unique<audio::Silent>();
+    else
+        this->audio = std::make_unique<audio::Sdl>();
+}
+
+void Chip8::load(mem::Memory &ram, const rom::Program &program) {
+    // Set up glyph data
+    ram.write(0, reinterpret_cast<const std::uint8_t *>(glyphs.data()), sizeof(glyphs));
+
+    // Set up program in address space, straight from the shared image
+    ram.write(ProgramStart, program.data(), std::min<std::size_t>(program.size(), AddressSpaceEnd - ProgramStart));
+}
 
-    audio::initialize(this->regs.ST);
+void Chip8::load(Ram &ram, const rom::Program &program) {
+    mem::Memory memory;
+    Chip8::load(memory, program);
+    memory.copy_to(ram.data());
 }
 
-Chip8::~Chip8() {
-    this->timer_thread_should_stop = true;
-    this->timer_thread.join();
-    audio::finalize();
+Chip8::Chip8(const Chip8 &parent):
+        regs(parent.regs), ram(parent.ram), stack(parent.stack), window(std::make_unique<win::Headless>()),
+        scheduler(parent.scheduler.get_ipf()), rng(parent.rng), mode(parent.mode), parked(parent.parked),
+        rng_seed(parent.rng_seed), icache(parent.icache), idle(parent.idle), audio(std::make_unique<audio::Silent>()) {
+    this->window->buf = parent.window->buf;
+    this->window->set_keys(parent.window->get_keys());
+    this->scheduler.restore(parent.scheduler.cycles, parent.scheduler.frames, parent.scheduler.remaining());
+
+    // Native code is per machine, children translate their own
+    if (this->mode == Mode::Block)
+        this->blocks = std::make_unique<blk::BlockCache>();
+    else if (this->mode == Mode::Jit)
+        this->blocks = std::make_unique<blk::BlockCache>(std::make_unique<jit::Compiler>());
+    if (parent.aot)
+        this->aot = std::make_unique<aot::Runtime>(*parent.aot);
+}
+
+Chip8::~Chip8() = default;
+
+std::unique_ptr<Chip8> Chip8::fork() const {
+    return std::unique_ptr<Chip8>(new Chip8(*this));
 }
 
 void Chip8::cycle() {
-    this->window.update();
-    if (this->window.should_pause) {
-        this->window.draw_pause();
+    if (this->paused())
         return;
+
+    this->execute();
+    this->parked = false;
+    this->retire(1);
+}
+
+std::size_t Chip8::step(std::size_t limit) {
+    if (this->paused())
+        return 0;
+
+    // Units that could cross a frame boundary or the limit are single-stepped, so timers tick
+    // and runs stop at the same instruction whatever the mode. Profiles and traces show idle loops as run
+    auto budget  = std::min<std::uint64_t>(this->scheduler.remaining(), limit);
+    auto hooked  = this->tracer || (prof::enabled && this->profiler);
+    auto length  = hooked ? std::uint8_t(0) : this->idle_length(this->regs.PC);
+    auto retired = (length && (2 * length <= budget)) ? this->fast_forward(length, budget) : this->dispatch(budget);
+
+    // Fx0A found no key, and none can arrive before the next frame or the limit:
+    // account for the retries it would spin through instead of executing them
+    if (this->parked) {
+        this->parked = false;
+        retired = budget;
     }
 
-    std::uint16_t op = *reinterpret_cast<std::uint16_t *>(&this->ram[this->regs.PC]);
-    auto ins = decode(ins::Opcode(__builtin_bswap16(op)));
-    ins->execute(*this);
-    this->regs.PC += 2;
+    this->retire(retired);
+    return retired;
 }
 
-ins::Instruction *Chip8::decode(ins::Opcode op) noexcept {
-    cur_ins.reset(new ins::Instruction(op));
-    switch ((op & 0xf000) >> 12) {
-        case 0:
-            if (ins::Cls::match(op))
-                cur_ins.reset(new ins::Cls(op));
-            else if (ins::Ret::match(op))
-                cur_ins.reset(new ins::Ret(op));
-            else
-                cur_ins.reset(new ins::Sys(op));
+std::size_t Chip8::run_frame(std::size_t limit) {
+    std::size_t retired = 0;
+    auto frame = this->scheduler.frames;
+    while ((this->scheduler.frames == frame) && (retired < limit)) {
+        auto n = this->step(limit - retired);
+        if (!n) // Paused
             break;
+        retired += n;
+    }
 
-        case 1:
-            cur_ins.reset(new ins::Jp(op));
-            break;
+    if ((retired < limit) && !this->window->should_fast_forward)
+        this->scheduler.pace();
+    return retired;
+}
 
-        case 2:
-            cur_ins.reset(new ins::Call(op));
-            break;
+void Chip8::seed(std::uint64_t seed) noexcept {
+    this->rng_seed = seed;
+    this->rng.seed(seed);
+}
 
-        case 3:
-            cur_ins.reset(new ins::Se(op));
-            break;
+void Chip8::save(snap::State &state) const noexcept {
+    state.header      = {};
+    state.header.size = sizeof(snap::State);
+    state.regs        = this->regs;
+    state.stack       = this->stack;
+    state.buf         = this->window->buf;
+    state.keys        = this->window->get_keys();
+    state.cycles      = this->scheduler.cycles;
+    state.frames      = this->scheduler.frames;
+    state.remaining   = this->scheduler.remaining();
+    state.rng         = this->rng.state;
+    this->ram.copy_to(state.ram.data());
+}
 
-        case 4:
-            cur_ins.reset(new ins::Sne(op));
-            break;
+void Chip8::restore(const snap::State &state) noexcept {
+    this->regs  = state.regs;
+    this->stack = state.stack;
+    this->ram.assign(state.ram.data());
+    this->window->buf = state.buf;
+    this->window->set_keys(state.keys);
+    this->window->dirty = ~0u;
+    this->scheduler.restore(state.cycles, state.frames, state.remaining);
+    this->rng.state = state.rng;
+
+    // Everything derived from memory may be stale
+    this->parked = false;
+    this->icache.clear();
+    this->idle.clear();
+    if (this->blocks)
+        this->blocks->clear();
+    if (this->aot)
+        this->aot->reset(state.ram.data());
+}
 
-        case 5:
-            if (ins::Se::match(op))
-                cur_ins.reset(new ins::Se(op));
-            break;
+std::uint64_t Chip8::hash() const noexcept {
+    auto h = utils::fnv1a(&this->regs, sizeof(this->regs));
+    h = this->ram.hash(h);
+    h = utils::fnv1a(this->stack.data(), sizeof(this->stack), h);
+    h = utils::fnv1a(this->window->buf.data(), sizeof(this->window->buf), h);
+    return h;
+}
 
-        case 6:
-            cur_ins.reset(new ins::Ld(op));
-            break;
+const Decoded &Chip8::refill(Address addr) noexcept {
+    auto op = ins::Opcode(this->ram[addr] << 8 | this->ram[(addr + 1) & address_mask]);
+    return this->icache.at(addr) = { op, ins::decode(op), true };
+}
 
-        case 7:
-            cur_ins.reset(new ins::Add(op));
-            break;
+std::uint8_t Chip8::idle_length(Address addr) noexcept {
+    using ins::Kind;
 
-        case 8:
-            switch (op & 0x000f) {
-                case 0:
-                    cur_ins.reset(new ins::Ld(op));   break;
-                case 1:
-                    cur_ins.reset(new ins::Or(op));   break;
-                case 2:
-                    cur_ins.reset(new ins::And(op));  break;
-                case 3:
-                    cur_ins.reset(new ins::Xor(op));  break;
-                case 4:
-                    cur_ins.reset(new ins::Add(op));  break;
-                case 5:
-                    cur_ins.reset(new ins::Sub(op));  break;
-                case 6:
-                    cur_ins.reset(new ins::Shr(op));  break;
-                case 7:
-                    cur_ins.reset(new ins::Subn(op)); break;
-                case 0xe:
-                    cur_ins.reset(new ins::Shl(op));  break;
-            }
-            break;
+    addr &= address_mask;
+    if (auto entry = this->idle[addr]; entry)
+        return entry - 1;
 
-        case 9:
-            if (ins::Sne::match(op))
-                cur_ins.reset(new ins::Sne(op));
-            break;
+    auto next = [&addr] { return addr = (addr + sizeof(ins::Opcode)) & address_mask; };
+    auto jumps_back = [this](Address at, Address to) {
+        auto &decoded = this->fetch(at);
+        return (decoded.kind == Kind::Jp) && (decoded.op.addr() == to);
+    };
 
-        case 0xa:
-            cur_ins.reset(new ins::Ld(op));
-            break;
+    auto start = addr;
+    std::uint8_t length = 0;
+    while ((length < max_idle_body) && ((this->fetch(addr).kind == Kind::LdDt) || (this->fetch(addr).kind == Kind::LdImm)))
+        ++length, next();
 
-        case 0xb:
-            cur_ins.reset(new ins::Jp(op));
+    // Sknp consumes the key it loops on, so only Skp qualifies
+    switch (auto kind = this->fetch(addr).kind; kind) {
+        case Kind::Jp:
+            length = jumps_back(addr, start) ? length + 1 : 0;
             break;
-
-        case 0xc:
-            cur_ins.reset(new ins::Rnd(op));
+        case Kind::SeImm:
+        case Kind::SeReg:
+        case Kind::SneImm:
+        case Kind::SneReg:
+        case Kind::Skp:
+            length = jumps_back(next(), start) ? length + 2 : 0;
             break;
-
-        case 0xd:
-            cur_ins.reset(new ins::Drw(op));
+        default:
+            length = 0;
             break;
+    }
 
-        case 0xe:
-            if (ins::Skp::match(op))
-                cur_ins.reset(new ins::Skp(op));
-            else if (ins::Sknp::match(op))
-                cur_ins.reset(new ins::Sknp(op));
-            break;
+    this->idle.at(start) = length + 1;
+    return length;
+}
 
-        case 0xf:
-            if (ins::Add::match(op))
-                cur_ins.reset(new ins::Add(op));
-            else if (ins::Ld::match(op))
-                cur_ins.reset(new ins::Ld(op));
-            break;
+std::size_t Chip8::fast_forward(std::uint8_t length, std::size_t budget) {
+    // Run one iteration, if it came back to the same state so will every other one until
+    // the budget runs out, since timers and keys only change between budgets
+    auto start  = this->regs.PC;
+    auto before = this->regs;
+    for (std::uint8_t i = 0; i < length; ++i)
+        this->execute();
+
+    if ((this->regs.PC != start) || std::memcmp(&before, &this->regs, sizeof(Registers)))
+        return length;
+    return budget - (budget % length);
+}
+
+bool Chip8::paused() {
+    if (!this->window->should_pause)
+        return false;
+
+    // Frames stop while paused, keep polling for the unpause key
+    this->poll();
+    this->handle_snapshot();
+    this->handle_rewind();
+    return this->window->should_pause;
+}
+
+void Chip8::poll() {
+    if (!this->movie) {
+        this->window->update();
+        return;
+    }
+
+    // Presses only enter the machine here, at an exact cycle, so replaying them at the same
+    // cycle makes every later Skp/Sknp/Fx0A observe the same keys
+    auto before = this->window->get_keys();
+    this->window->update();
+    auto &after = this->window->get_keys();
+    for (std::size_t key = 0; key < after.size(); ++key) {
+        for (auto n = before[key]; n < after[key]; ++n)
+            this->movie->script.push_back({ this->scheduler.cycles, static_cast<win::Key>(key) });
+    }
+}
+
+void Chip8::tick() {
+    this->poll();
+
+    if (this->regs.DT)
+        --this->regs.DT;
+    if (this->regs.ST)
+        --this->regs.ST;
+    this->audio->beep(this->regs.ST);
+
+    this->handle_snapshot();
+    if (this->history && !this->handle_rewind()) {
+        snap::State state;
+        this->save(state);
+        this->history->push(state);
+    }
+}
+
+void Chip8::handle_snapshot() {
+    auto &window = *this->window;
+    if (!window.should_save && !window.should_load)
+        return;
+
+    snap::State state;
+    if (window.should_save && !this->snapshot_path.empty()) {
+        this->save(state);
+        if (snap::write(this->snapshot_path, state))
+            INFO("Saved state to %s\n", this->snapshot_path.c_str());
+    }
+    if (window.should_load && this->movie) {
+        // Going back would record key presses out of order
+        INFO("Loading states is disabled while recording\n");
+    } else if (window.should_load && !this->snapshot_path.empty()) {
+        if (snap::read(this->snapshot_path, state))
+            this->restore(state);
+    }
+    window.should_save = window.should_load = false;
+}
+
+bool Chip8::handle_rewind() {
+    if (!this->window->should_rewind)
+        return false;
+    this->window->should_rewind = false;
+    if (this->movie) {
+        INFO("Rewinding is disabled while recording\n");
+        return false;
+    }
+
+    snap::State state;
+    if (!this->history || !this->history->rewind(sched::frame_rate, state))
+        return false;
+    this->restore(state);
+    return true;
+}
+
+std::size_t Chip8::dispatch(std::size_t remaining) {
+    if (this->aot) {
+        if (auto *entry = this->aot->lookup(this->regs.PC); entry && (entry->size() <= remaining))
+            return entry->fn(*this);
     }
 
-    return cur_ins.get();
+    if (this->blocks) {
+        if (auto *block = this->blocks->lookup(*this, this->regs.PC); block && (block->size() <= remaining))
+            return this->blocks->execute(*this, *block);
+    }
+
+    this->execute();
+    return 1;
+}
+
+void Chip8::execute() {
+    auto &decoded = this->fetch(this->regs.PC & address_mask);
+
+    if (this->tracer) {
+        auto pc   = this->regs.PC;
+        auto op   = decoded.op;
+        auto kind = decoded.kind;
+        auto addr = this->regs.I;
+        ins::handler(kind)(*this, op);
+        this->tracer->push(trace::Record{
+            static_cast<std::uint32_t>(this->scheduler.cycles), pc, op, this->regs.I, addr,
+            this->regs[op.x()], this->regs.Vf, trace::written(kind, op), this->regs.DT,
+        });
+        if (auto moved = trace::moved(kind, op); moved) {
+            trace::Payload payload{};
+            this->ram.read(addr, payload.bytes.data(), moved);
+            this->tracer->push(payload);
+        }
+        this->regs.PC += 2;
+        return;
+    }
+
+    if constexpr (prof::enabled) {
+        if (this->profiler) {
+            auto pc   = this->regs.PC;
+            auto kind = decoded.kind;
+            this->profiler->begin();
+            ins::handler(kind)(*this, decoded.op);
+            this->profiler->end(pc, kind);
+            this->regs.PC += 2;
+            return;
+        }
+    }
+
+    ins::handler(decoded.kind)(*this, decoded.op);
+    this->regs.PC += 2;
+}
+
+std::unique_ptr<ins::Instruction> Chip8::decode(ins::Opcode op) {
+    return ins::visit(op, [](auto instruction) -> std::unique_ptr<ins::Instruction> {
+        return std::make_unique<decltype(instruction)>(instruction);
+    });
 }
 
 } // namespace c8
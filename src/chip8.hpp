@@ -18,18 +18,45 @@
 #pragma once
 
 #include <cstdint>
-#include <atomic>
 #include <memory>
-#include <thread>
-#include <chrono>
+#include <string>
 
+#include "aot.hpp"
+#include "audio.hpp"
+#include "block.hpp"
 #include "instruction.hpp"
+#include "memory.hpp"
+#include "random.hpp"
 #include "rom.hpp"
+#include "scheduler.hpp"
+#include "script.hpp"
 #include "window.hpp"
 
-namespace c8 {
+namespace c8::snap {
+
+struct State;
+
+} // namespace c8::snap
+
+namespace c8::rwd {
+
+class History;
+
+} // namespace c8::rwd
+
+namespace c8::prof {
+
+class Profiler;
+
+} // namespace c8::prof
+
+namespace c8::trace {
+
+class Writer;
 
-using namespace std::chrono_literals;
+} // namespace c8::trace
+
+namespace c8 {
 
 using Address = std::uint16_t;
 
@@ -43,10 +70,26 @@ enum AddressSpace: Address {
     AddressSpaceEnd   = 0x1000,
 };
 
+constexpr static Address address_mask = AddressSpaceEnd - 1;
+
 using Stack = std::array<Address, 0x10>;
-using Ram   = std::array<std::uint8_t, AddressSpaceEnd>;
+using Ram   = std::array<std::uint8_t, AddressSpaceEnd>; // Flat image, machines page theirs
+static_assert(mem::size == AddressSpaceEnd);
+
+// Predecoded instruction starting at a given address
+struct Decoded {
+    ins::Opcode op;
+    ins::Kind   kind;
+    bool        valid;
+};
+ASSERT_SIZE(Decoded, 4);
 
-static inline auto timer_rate = 16.67ms;
+// Shared with forks until either side writes to it. A single page keeps lookups one load
+// away from the machine, like a flat array
+using DecodeCache = mem::Paged<Decoded, AddressSpaceEnd>;
+using IdleCache   = mem::Paged<std::uint8_t, AddressSpaceEnd>;
+extern template class mem::Paged<Decoded, AddressSpaceEnd>;
+extern template class mem::Paged<std::uint8_t, AddressSpaceEnd>;
 
 struct Registers {
     // General-purpose registers
@@ -69,24 +112,149 @@ struct Registers {
 
 class Chip8 {
     public:
-        Chip8(const std::shared_ptr<rom::Program> &program);
+        enum class Mode {
+            Interpreter, // One instruction per dispatch
+            Block,       // One basic block per dispatch
+            Jit,         // Like Block, hot blocks get translated to native code
+            Aot,         // Blocks precompiled by the static recompiler, when linked in
+        };
+
+        // Headless machines have no display nor sound, only get input through window->press,
+        // and are not paced to real time
+        Chip8(const std::shared_ptr<const rom::Program> &program, Mode mode = Mode::Interpreter, bool headless = false,
+            std::uint32_t ipf = sched::default_ipf);
         ~Chip8();
 
-        static ins::Instruction *decode(ins::Opcode op) noexcept;
+        // Lays out the glyphs and the program the way the machine boots with them
+        static void load(mem::Memory &ram, const rom::Program &program);
+        static void load(Ram &ram, const rom::Program &program);
+
+        // Only meant for disassembly, execution goes through ins::execute
+        static std::unique_ptr<ins::Instruction> decode(ins::Opcode op);
 
+        // Executes a single instruction
         void cycle();
 
-    protected:
-        static inline std::unique_ptr<ins::Instruction> cur_ins;
+        // Executes one dispatch unit of the current mode retiring at most limit instructions,
+        // returns the number of instructions retired
+        std::size_t step(std::size_t limit = SIZE_MAX);
+
+        // Steps until the next frame boundary or until limit instructions were retired,
+        // then paces to real time if the frame completed, unless fast-forwarding
+        std::size_t run_frame(std::size_t limit = SIZE_MAX);
+
+        // Called by Fx0A when no key is pending, idles the machine until the next frame
+        inline void park() noexcept {
+            this->parked = true;
+        }
+
+        // Random sequence used by Cxkk, picked from the host at construction
+        void seed(std::uint64_t seed) noexcept;
+
+        inline std::uint64_t get_seed() const noexcept {
+            return this->rng_seed;
+        }
+
+        // Copies the whole machine state out and back in, caches are rebuilt from the restored memory
+        void save(snap::State &state) const noexcept;
+        void restore(const snap::State &state) noexcept;
+
+        // Headless and silent child continuing from the current state: registers, stack, memory,
+        // framebuffer, pending keys, timers and random sequence. Memory pages and the decode and
+        // idle caches stay shared with this machine until either writes to them, recorders and
+        // hooks are not inherited
+        std::unique_ptr<Chip8> fork() const;
+
+        // Digest of the architectural state (registers, memory, stack, framebuffer)
+        std::uint64_t hash() const noexcept;
+
+        // Decodes lazily, entries stay valid until the underlying bytes are written
+        inline const Decoded &fetch(Address addr) noexcept {
+            if (auto &entry = this->icache[addr]; entry.valid)
+                return entry;
+            return this->refill(addr);
+        }
+
+        // All stores into ram from executed code must go through here
+        inline void write(Address addr, std::uint8_t value) noexcept {
+            addr &= address_mask;
+            this->ram.set(addr, value);
+            for (auto start: { addr, Address((addr - 1) & address_mask) }) {
+                if (this->icache[start].valid)
+                    this->icache.at(start).valid = false;
+            }
+            if (this->blocks)
+                this->blocks->invalidate(addr);
+            if (this->aot)
+                this->aot->invalidate(addr);
+
+            // Forget idle loops that could include this byte
+            for (int i = 0; i < 2 * (max_idle_body + 2); ++i) {
+                if (auto start = Address((addr - i) & address_mask); this->idle[start])
+                    this->idle.at(start) = 0;
+            }
+        }
 
     public:
-        std::thread      timer_thread;
-        std::atomic_bool timer_thread_should_stop = false;
+        Registers                       regs{};
+        mem::Memory                     ram;
+        Stack                           stack{};
+        std::unique_ptr<win::Window>    window;
+        sched::Scheduler                scheduler;
+        std::string                     snapshot_path; // Target of the save/load hotkeys
+        std::unique_ptr<rwd::History>   history;       // Recorded every frame when set
+        std::unique_ptr<script::Movie>  movie;         // Key presses get recorded into it when set
+        std::unique_ptr<prof::Profiler> profiler;      // Fed by every interpreted instruction in profiling builds
+        std::unique_ptr<trace::Writer>  tracer;        // Fed by every interpreted instruction when set
+        rng::Generator                  rng;
+
+    protected:
+        // Used by fork()
+        Chip8(const Chip8 &parent);
+
+        void execute();
+        std::size_t dispatch(std::size_t remaining);
+
+        // Decodes into the cache, kept out of line so fetch inlines
+        const Decoded &refill(Address addr) noexcept;
+
+        bool paused();
+
+        // Instructions per iteration of the idle loop starting at addr, 0 if there is none
+        std::uint8_t idle_length(Address addr) noexcept;
+        std::size_t fast_forward(std::uint8_t length, std::size_t budget);
+
+        // Updates the window, recording the key presses it delivered
+        void poll();
+
+        // 60 Hz timer and display update
+        void tick();
+
+        // Saves or loads snapshot_path when the window asked for it
+        void handle_snapshot();
+
+        // Goes back one second when the window asked for it, returns whether it did
+        bool handle_rewind();
+
+        inline void retire(std::size_t retired) {
+            if (this->scheduler.advance(retired))
+                this->tick();
+        }
+
+    protected:
+        Mode                             mode;
+        bool                             parked = false;
+        std::uint64_t                    rng_seed = 0;
+        DecodeCache                      icache;
 
-        Registers   regs{};
-        Ram         ram{};
-        Stack       stack{};
-        win::Window window{};
+        // Idle loops are a few Fx07/6xkk followed by a jump back, possibly through a skip on
+        // registers or a key, whose iterations leave the machine unchanged until a timer tick
+        // or key press. Entries hold the iteration length + 1, 0 when not analysed yet
+        constexpr static int                      max_idle_body = 4;
+        IdleCache                                 idle;
+        std::unique_ptr<blk::BlockCache> blocks;
+        std::unique_ptr<aot::Runtime>    aot;
+        std::unique_ptr<audio::Audio>    audio;
 };
 
 } // namespace c8
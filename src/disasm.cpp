@@ -0,0 +1,119 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+
+#include "cfg.hpp"
+#include "chip8.hpp"
+#include "instruction.hpp"
+
+#include "disasm.hpp"
+
+namespace c8::dis {
+
+using ins::Kind;
+
+namespace {
+
+enum Flags: std::uint8_t {
+    Code       = 1 << 0, // An instruction starts here
+    Subroutine = 1 << 1, // Call target
+    Target     = 1 << 2, // Jump target
+    Table      = 1 << 3, // Base of a Bnnn jump table
+    Data       = 1 << 4, // Loaded into I, usually sprites
+};
+
+const char *label(std::uint8_t flags) {
+    if (flags & Subroutine)
+        return "sub";
+    if (flags & Target)
+        return "loc";
+    if (flags & Table)
+        return "table";
+    if (flags & Data)
+        return "data";
+    return nullptr;
+}
+
+} // namespace
+
+bool disassemble(std::FILE *fp, const std::uint8_t *mem, std::size_t size) {
+    std::array<std::uint8_t, AddressSpaceEnd> flags{};
+    auto graph = cfg::build(mem, ProgramStart);
+
+    // Ignore the zero padding ROM loading leaves behind
+    auto *program = mem + ProgramStart;
+    size = std::min<std::size_t>(size, AddressSpaceEnd - ProgramStart);
+    while (size && !program[size - 1])
+        --size;
+    std::size_t end = ProgramStart + size;
+
+    for (auto &[start, node]: graph) {
+        for (std::size_t addr = start; addr < node.end; addr += sizeof(ins::Opcode)) {
+            flags[addr] |= Code;
+            auto op = cfg::read(mem, addr);
+            switch (ins::decode(op)) {
+                case Kind::Jp:
+                    flags[op.addr()] |= Target;
+                    break;
+                case Kind::Call:
+                    flags[op.addr()] |= Subroutine;
+                    break;
+                case Kind::JpV0:
+                    flags[op.addr()] |= Table;
+                    break;
+                case Kind::LdI:
+                    flags[op.addr()] |= Data;
+                    break;
+                default:
+                    break;
+            }
+        }
+        end = std::max<std::size_t>(end, node.end);
+    }
+
+    std::size_t instructions = 0, data = 0, subroutines = 0;
+    for (std::size_t addr = ProgramStart; addr < end;) {
+        if (auto *name = label(flags[addr]); name)
+            std::fprintf(fp, "%s_%03zx:\n", name, addr);
+        subroutines += !!(flags[addr] & Subroutine);
+
+        if (flags[addr] & Code) {
+            auto op = cfg::read(mem, addr);
+            std::fprintf(fp, "  %04zx: %04x -> ", addr, static_cast<std::uint16_t>(op));
+            ins::print(op, fp);
+            ++instructions;
+
+            // Code reached at both alignments gets listed twice, overlapping
+            addr += ((addr + 1 < end) && (flags[addr + 1] & Code)) ? 1 : sizeof(ins::Opcode);
+            continue;
+        }
+
+        // One byte per line, drawn the way a sprite row would be
+        char pixels[9] = {};
+        for (int i = 0; i < 8; ++i)
+            pixels[i] = (mem[addr] & (0x80 >> i)) ? '#' : '.';
+        std::fprintf(fp, "  %04zx: %02x   -> DB      0x%02x    %s\n", addr, mem[addr], mem[addr], pixels);
+        ++data, ++addr;
+    }
+
+    std::fprintf(fp, "%zu instructions, %zu data bytes, %zu subroutines\n", instructions, data, subroutines);
+    return !std::ferror(fp);
+}
+
+} // namespace c8::dis
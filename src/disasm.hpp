@@ -0,0 +1,31 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace c8::dis {
+
+// Lists the program loaded at ProgramStart in a full 4 KiB memory image. Code is found by
+// following control flow from the entry point, so data and misaligned code are shown as such.
+// size is the length of the program, code reached past it is listed too
+bool disassemble(std::FILE *fp, const std::uint8_t *mem, std::size_t size);
+
+} // namespace c8::dis
@@ -18,7 +18,6 @@
 #include <algorithm>
 #include <climits>
 #include <limits>
-#include <experimental/random>
 
 #include "chip8.hpp"
 #include "instruction.hpp"
@@ -33,263 +32,322 @@ namespace c8::ins {
 using reg_lim = std::numeric_limits<std::uint8_t>;
 
 // Instruction implementations
-void Instruction::execute(Chip8 &c) const {
-    UNUSED(c);
+namespace impl {
+
+void unknown(Chip8 &c, Opcode op) {
+    UNUSED(c); UNUSED(op);
     ERROR("Unknown instruction\n");
 }
 
-void Cls::execute(Chip8 &c) const {
-    c.window.clear();
+void cls(Chip8 &c, Opcode op) {
+    UNUSED(op);
+    c.window->clear();
 }
 
-void Ret::execute(Chip8 &c) const {
-    c.regs.PC = c.stack[--c.regs.SP];
+void ret(Chip8 &c, Opcode op) {
+    UNUSED(op);
+    c.regs.SP = (c.regs.SP - 1) & (c.stack.size() - 1);
+    c.regs.PC = c.stack[c.regs.SP];
 }
 
-void Sys::execute(Chip8 &c) const {
-    UNUSED(c);
+void sys(Chip8 &c, Opcode op) {
+    UNUSED(c); UNUSED(op);
     // Instruction deprecated
     // c.regs.PC = op.addr() - 2;
 }
 
-void Jp::execute(Chip8 &c) const {
-    if (COMP(1))
-        c.regs.PC = op.addr();
-    else if (COMP_MASK(mask_1, compare_2))
-        c.regs.PC = c.regs.V0 + op.addr();
-    c.regs.PC -= 2;
+void jp(Chip8 &c, Opcode op) {
+    c.regs.PC = op.addr() - 2;
 }
 
-void Call::execute(Chip8 &c) const {
-    c.stack[c.regs.SP++] = c.regs.PC;
+void jp_v0(Chip8 &c, Opcode op) {
+    c.regs.PC = c.regs.V0 + op.addr() - 2;
+}
+
+void call(Chip8 &c, Opcode op) {
+    // Some roms don't return from every call: INVADERS jumps back to its title screen from a
+    // subroutine, leaking a frame per game over. Deeper calls overwrite the oldest frames
+    // instead of running into the rest of the machine
+    static_assert(!(std::tuple_size_v<Stack> & (std::tuple_size_v<Stack> - 1)), "Stack size must be a power of 2");
+    c.stack[c.regs.SP & (c.stack.size() - 1)] = c.regs.PC;
+    c.regs.SP = (c.regs.SP + 1) & (c.stack.size() - 1);
     c.regs.PC = op.addr() - 2;
 }
 
-void Se::execute(Chip8 &c) const {
-    if (COMP(1) && (c.regs[op.x()] == op.byte()))
+void se_imm(Chip8 &c, Opcode op) {
+    if (c.regs[op.x()] == op.byte())
         c.regs.PC += 2;
-    else if (COMP(2) && (c.regs[op.x()] == c.regs[op.y()]))
+}
+
+void se_reg(Chip8 &c, Opcode op) {
+    if (c.regs[op.x()] == c.regs[op.y()])
         c.regs.PC += 2;
 }
 
-void Sne::execute(Chip8 &c) const {
-    if (COMP(1) && (c.regs[op.x()] != op.byte()))
+void sne_imm(Chip8 &c, Opcode op) {
+    if (c.regs[op.x()] != op.byte())
         c.regs.PC += 2;
-    else if (COMP(2) && (c.regs[op.x()] != c.regs[op.y()]))
+}
+
+void sne_reg(Chip8 &c, Opcode op) {
+    if (c.regs[op.x()] != c.regs[op.y()])
         c.regs.PC += 2;
 }
 
-void Ld::execute(Chip8 &c) const {
-    if (COMP(1))
-        c.regs[op.x()] = op.byte();
-    else if (COMP_MASK(mask_1, 0xa000))
-        c.regs.I = op.addr();
-    else if (COMP(2))
-        c.regs[op.x()] = c.regs[op.y()];
-    else if (COMP_MASK(0x00ff, 0x0007))
-        c.regs[op.x()] = c.regs.DT;
-    else if (COMP_MASK(0x00ff, 0x000a))
-        c.regs[op.x()] = c.window.wait_for_key();
-    else if (COMP_MASK(0x00ff, 0x0015))
-        c.regs.DT = c.regs[op.x()];
-    else if (COMP_MASK(0x00ff, 0x0018))
-        c.regs.ST = c.regs[op.x()];
-    else if (COMP_MASK(0x00ff, 0x0029))
-        c.regs.I = c.regs[op.x()] * 5 * sizeof(std::uint8_t);
-    else if (COMP_MASK(0x00ff, 0x0033)) {
-        c.ram[c.regs.I + 0] =  c.regs[op.x()] / 100;
-        c.ram[c.regs.I + 1] = (c.regs[op.x()] / 10) % 10;
-        c.ram[c.regs.I + 2] =  c.regs[op.x()] % 10;
-    } else if (COMP_MASK(0x00ff, 0x0055)) {
-        for (std::uint8_t i = 0; i <= op.x(); ++i)
-            c.ram[c.regs.I + i] = c.regs[i];
-    } else if (COMP_MASK(0x00ff, 0x0065)) {
-        for (std::uint8_t i = 0; i <= op.x(); ++i)
-            c.regs[i] = c.ram[c.regs.I + i];
+void ld_imm(Chip8 &c, Opcode op) {
+    c.regs[op.x()] = op.byte();
+}
+
+void ld_reg(Chip8 &c, Opcode op) {
+    c.regs[op.x()] = c.regs[op.y()];
+}
+
+void ld_i(Chip8 &c, Opcode op) {
+    c.regs.I = op.addr();
+}
+
+void ld_dt(Chip8 &c, Opcode op) {
+    c.regs[op.x()] = c.regs.DT;
+}
+
+void ld_key(Chip8 &c, Opcode op) {
+    // Retry until a key arrives, so the caller keeps control while waiting
+    if (auto key = c.window->pop_key(); win::Window::is_key_in_range(key)) {
+        c.regs[op.x()] = key;
+    } else {
+        c.regs.PC -= 2;
+        c.park();
     }
 }
 
-void Add::execute(Chip8 &c) const {
-    if (COMP(1))
-        c.regs[op.x()] += op.byte();
-    else if (COMP(2)) {
-        c.regs.Vf = (c.regs[op.x()] + c.regs[op.y()]) > reg_lim::max();
-        c.regs[op.x()] = c.regs[op.x()] + c.regs[op.y()];
-    } else if (COMP_MASK(0xf0ff, 0xf01e))
-        c.regs.I += c.regs[op.x()];
+void set_dt(Chip8 &c, Opcode op) {
+    c.regs.DT = c.regs[op.x()];
+}
+
+void set_st(Chip8 &c, Opcode op) {
+    c.regs.ST = c.regs[op.x()];
+}
+
+void ld_font(Chip8 &c, Opcode op) {
+    c.regs.I = c.regs[op.x()] * 5 * sizeof(std::uint8_t);
+}
+
+void ld_bcd(Chip8 &c, Opcode op) {
+    c.write(c.regs.I + 0,  c.regs[op.x()] / 100);
+    c.write(c.regs.I + 1, (c.regs[op.x()] / 10) % 10);
+    c.write(c.regs.I + 2,  c.regs[op.x()] % 10);
+}
+
+void ld_store(Chip8 &c, Opcode op) {
+    for (std::uint8_t i = 0; i <= op.x(); ++i)
+        c.write(c.regs.I + i, c.regs[i]);
+}
+
+void ld_load(Chip8 &c, Opcode op) {
+    c.ram.read(c.regs.I, &c.regs[0], op.x() + 1);
+}
+
+void add_imm(Chip8 &c, Opcode op) {
+    c.regs[op.x()] += op.byte();
 }
 
-void Or::execute(Chip8 &c) const {
+void add_reg(Chip8 &c, Opcode op) {
+    c.regs.Vf = (c.regs[op.x()] + c.regs[op.y()]) > reg_lim::max();
+    c.regs[op.x()] = c.regs[op.x()] + c.regs[op.y()];
+}
+
+void add_i(Chip8 &c, Opcode op) {
+    c.regs.I += c.regs[op.x()];
+}
+
+void or_(Chip8 &c, Opcode op) {
     c.regs[op.x()] |= c.regs[op.y()];
 }
 
-void And::execute(Chip8 &c) const {
+void and_(Chip8 &c, Opcode op) {
     c.regs[op.x()] &= c.regs[op.y()];
 }
 
-void Xor::execute(Chip8 &c) const {
+void xor_(Chip8 &c, Opcode op) {
     c.regs[op.x()] ^= c.regs[op.y()];
 }
 
-void Sub::execute(Chip8 &c) const {
+void sub(Chip8 &c, Opcode op) {
     c.regs.Vf = c.regs[op.x()] > c.regs[op.y()];
     c.regs[op.x()] -= c.regs[op.y()];
 }
 
-void Shr::execute(Chip8 &c) const {
+void shr(Chip8 &c, Opcode op) {
     c.regs.Vf = c.regs[op.x()] & (1 << 0);
     c.regs[op.x()] >>= 1;
 }
 
-void Subn::execute(Chip8 &c) const {
+void subn(Chip8 &c, Opcode op) {
     c.regs.Vf = c.regs[op.y()] > c.regs[op.x()];
     c.regs[op.x()] = c.regs[op.y()] - c.regs[op.x()];
 }
 
-void Shl::execute(Chip8 &c) const {
+void shl(Chip8 &c, Opcode op) {
     c.regs.Vf = !!(c.regs[op.x()] & (1 << (reg_lim::digits - 1)));
     c.regs[op.x()] <<= 1;
 }
 
-void Rnd::execute(Chip8 &c) const {
-    c.regs[op.x()] = std::experimental::randint(static_cast<int>(reg_lim::min()), static_cast<int>(reg_lim::max())) & op.byte();
+void rnd(Chip8 &c, Opcode op) {
+    c.regs[op.x()] = c.rng.byte() & op.byte();
 }
 
-void Drw::execute(Chip8 &c) const {
-    // Construct sprite
-    win::Sprite sprite;
-    sprite.resize(op.nibble());
-    std::copy_n(&c.ram[c.regs.I], op.nibble(), sprite.data());
+void drw(Chip8 &c, Opcode op) {
+    // Gather the sprite, wrapping around the address space like every other access
+    std::array<std::uint8_t, win::max_sprite_height> sprite;
+    c.ram.read(c.regs.I, sprite.data(), op.nibble());
 
     // Apply sprite & update
-    c.regs.Vf = c.window.apply_sprite(sprite, c.regs[op.x()], c.regs[op.y()]);
+    c.regs.Vf = c.window->apply_sprite(sprite.data(), op.nibble(), c.regs[op.x()], c.regs[op.y()]);
 }
 
-void Skp::execute(Chip8 &c) const {
-    if (c.window.is_key_down(static_cast<win::Key>(c.regs[op.x()])))
+void skp(Chip8 &c, Opcode op) {
+    if (c.window->is_key_down(static_cast<win::Key>(c.regs[op.x()])))
         c.regs.PC += 2;
 }
 
-void Sknp::execute(Chip8 &c) const {
-    if (c.window.is_key_up(static_cast<win::Key>(c.regs[op.x()])))
+void sknp(Chip8 &c, Opcode op) {
+    if (c.window->is_key_up(static_cast<win::Key>(c.regs[op.x()])))
         c.regs.PC += 2;
 }
 
+constexpr auto make_kinds() {
+    std::array<Kind, 0x10000> table{};
+    for (std::size_t i = 0; i < table.size(); ++i)
+        table[i] = classify(Opcode(static_cast<std::uint16_t>(i)));
+    return table;
+}
+
+} // namespace impl
+
+constexpr std::array<Kind, 0x10000> kinds = impl::make_kinds();
+
+void Instruction::execute(Chip8 &c) const {
+    ins::execute(c, op);
+}
+
 // Instruction printing
-void Instruction::print() const {
-    printf("INS     Unknown instruction\n");
+void Instruction::print(std::FILE *fp) const {
+    std::fprintf(fp, "INS     Unknown instruction\n");
 }
 
-void Cls::print() const {
-    printf("CLS\n");
+void Cls::print(std::FILE *fp) const {
+    std::fprintf(fp, "CLS\n");
 }
 
-void Ret::print() const {
-    printf("RET\n");
+void Ret::print(std::FILE *fp) const {
+    std::fprintf(fp, "RET\n");
 }
 
-void Sys::print() const {
-    printf("SYS     %#x\n", op.addr());
+void Sys::print(std::FILE *fp) const {
+    std::fprintf(fp, "SYS     %#x\n", op.addr());
 }
 
-void Jp::print() const {
-    printf("JP      %#x\n", op.addr());
+void Jp::print(std::FILE *fp) const {
+    if (COMP(1))
+        std::fprintf(fp, "JP      %#x\n", op.addr());
+    else if (COMP(2))
+        std::fprintf(fp, "JP      V0 %#x\n", op.addr());
 }
 
-void Call::print() const {
-    printf("CALL    %#x\n", op.addr());
+void Call::print(std::FILE *fp) const {
+    std::fprintf(fp, "CALL    %#x\n", op.addr());
 }
 
-void Se::print() const {
+void Se::print(std::FILE *fp) const {
     if (COMP(1))
-        printf("SE      V%x %#x\n", op.x(), op.byte());
+        std::fprintf(fp, "SE      V%x %#x\n", op.x(), op.byte());
     else if (COMP(2))
-        printf("SE      V%x V%x\n", op.x(), op.y());
+        std::fprintf(fp, "SE      V%x V%x\n", op.x(), op.y());
 }
 
-void Sne::print() const {
+void Sne::print(std::FILE *fp) const {
     if (COMP(1))
-        printf("SNE     V%x %#x\n", op.x(), op.byte());
+        std::fprintf(fp, "SNE     V%x %#x\n", op.x(), op.byte());
     else if (COMP(2))
-        printf("SNE     V%x V%x\n", op.x(), op.y());
+        std::fprintf(fp, "SNE     V%x V%x\n", op.x(), op.y());
 }
 
-void Ld::print() const {
+void Ld::print(std::FILE *fp) const {
     if (COMP(1))
-        printf("LD      V%x %#x\n", op.x(), op.byte());
+        std::fprintf(fp, "LD      V%x %#x\n", op.x(), op.byte());
     else if (COMP_MASK(mask_1, 0xa000))
-        printf("LD      I %#x\n", op.addr());
+        std::fprintf(fp, "LD      I %#x\n", op.addr());
     else if (COMP(2))
-        printf("LD      V%x V%x\n", op.x(), op.y());
+        std::fprintf(fp, "LD      V%x V%x\n", op.x(), op.y());
     else if (COMP_MASK(0x00ff, 0x0007))
-        printf("LD      V%x DT\n", op.x());
+        std::fprintf(fp, "LD      V%x DT\n", op.x());
     else if (COMP_MASK(0x00ff, 0x000a))
-        printf("LD      V%x K\n", op.x());
+        std::fprintf(fp, "LD      V%x K\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0015))
-        printf("LD      DT V%x\n", op.x());
+        std::fprintf(fp, "LD      DT V%x\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0018))
-        printf("LD      ST V%x\n", op.x());
+        std::fprintf(fp, "LD      ST V%x\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0029))
-        printf("LD      F V%x\n", op.x());
+        std::fprintf(fp, "LD      F V%x\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0033))
-        printf("LD      B V%x\n", op.x());
+        std::fprintf(fp, "LD      B V%x\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0055))
-        printf("LD      [I] V%x\n", op.x());
+        std::fprintf(fp, "LD      [I] V%x\n", op.x());
     else if (COMP_MASK(0x00ff, 0x0065))
-        printf("LD      V%x [I]\n", op.x());
+        std::fprintf(fp, "LD      V%x [I]\n", op.x());
 }
 
-void Add::print() const {
+void Add::print(std::FILE *fp) const {
     if (COMP(1))
-        printf("ADD     V%x %#x\n", op.x(), op.byte());
+        std::fprintf(fp, "ADD     V%x %#x\n", op.x(), op.byte());
     else if (COMP(2))
-        printf("ADD     V%x V%x\n", op.x(), op.y());
+        std::fprintf(fp, "ADD     V%x V%x\n", op.x(), op.y());
     else if (COMP_MASK(0xf0ff, 0xf01e))
-        printf("ADD     I %#x\n", op.x());
+        std::fprintf(fp, "ADD     I V%x\n", op.x());
 }
 
-void Or::print() const {
-    printf("OR      V%x V%x\n", op.x(), op.y());
+void Or::print(std::FILE *fp) const {
+    std::fprintf(fp, "OR      V%x V%x\n", op.x(), op.y());
 }
 
-void And::print() const {
-    printf("AND     V%x V%x\n", op.x(), op.y());
+void And::print(std::FILE *fp) const {
+    std::fprintf(fp, "AND     V%x V%x\n", op.x(), op.y());
 }
 
-void Xor::print() const {
-    printf("XOR     V%x V%x\n", op.x(), op.y());
+void Xor::print(std::FILE *fp) const {
+    std::fprintf(fp, "XOR     V%x V%x\n", op.x(), op.y());
 }
 
-void Sub::print() const {
-    printf("SUB     V%x V%x\n", op.x(), op.y());
+void Sub::print(std::FILE *fp) const {
+    std::fprintf(fp, "SUB     V%x V%x\n", op.x(), op.y());
 }
 
-void Shr::print() const {
-    printf("SHR     V%x V%x\n", op.x(), op.y());
+void Shr::print(std::FILE *fp) const {
+    std::fprintf(fp, "SHR     V%x V%x\n", op.x(), op.y());
 }
 
-void Subn::print() const {
-    printf("SUBN    V%x V%x\n", op.x(), op.y());
+void Subn::print(std::FILE *fp) const {
+    std::fprintf(fp, "SUBN    V%x V%x\n", op.x(), op.y());
 }
 
-void Shl::print() const {
-    printf("SHL     V%x V%x\n", op.x(), op.y());
+void Shl::print(std::FILE *fp) const {
+    std::fprintf(fp, "SHL     V%x V%x\n", op.x(), op.y());
 }
 
-void Rnd::print() const {
-    printf("RND     V%x V%x\n", op.x(), op.byte());
+void Rnd::print(std::FILE *fp) const {
+    std::fprintf(fp, "RND     V%x V%x\n", op.x(), op.byte());
 }
 
-void Drw::print() const {
-    printf("DRW     V%x V%x %#x\n", op.x(), op.y(), op.nibble());
+void Drw::print(std::FILE *fp) const {
+    std::fprintf(fp, "DRW     V%x V%x %#x\n", op.x(), op.y(), op.nibble());
 }
 
-void Skp::print() const {
-    printf("SKP     V%x\n", op.x());
+void Skp::print(std::FILE *fp) const {
+    std::fprintf(fp, "SKP     V%x\n", op.x());
 }
 
-void Sknp::print() const {
-    printf("SKNP    V%x\n", op.x());
+void Sknp::print(std::FILE *fp) const {
+    std::fprintf(fp, "SKNP    V%x\n", op.x());
 }
 
 } // namespace c8::ins
@@ -18,6 +18,9 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <array>
 #include <type_traits>
 
 #include "utils.hpp"
@@ -34,7 +37,7 @@ struct Opcode {
     std::uint16_t value = 0;
 
     constexpr inline Opcode() noexcept { }
-    constexpr inline Opcode(const Opcode &op) noexcept: value(op.value) { }
+    constexpr inline Opcode(const Opcode &op) noexcept = default;
     explicit constexpr inline Opcode(const std::uint16_t val) noexcept: value(val) { }
 
     constexpr inline operator const std::uint16_t &() const noexcept {
@@ -120,6 +123,9 @@ struct Opcode {
 };
 ASSERT_SIZE(Opcode, 2);
 
+// Passed in a register to handlers, which native code relies on
+static_assert(std::is_trivially_copy_constructible_v<Opcode>);
+
 static constexpr inline std::uint16_t mask_1 = 0xf000;
 static constexpr inline std::uint16_t mask_2 = 0xf00f;
 
@@ -127,8 +133,8 @@ struct Instruction {
     constexpr inline Instruction(Opcode op): op(op) { }
     virtual ~Instruction() = default;
 
-    virtual void execute(Chip8 &chip) const;
-    virtual void print() const;
+    void execute(Chip8 &chip) const;
+    virtual void print(std::FILE *fp = stdout) const;
 
 protected:
     Opcode op;
@@ -136,8 +142,7 @@ protected:
 
 struct Cls: public Instruction {
     constexpr inline Cls(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     static constexpr std::uint16_t mask      = 0xffff;
     static constexpr std::uint16_t compare   = 0x00e0;
@@ -148,8 +153,7 @@ struct Cls: public Instruction {
 
 struct Ret: public Instruction {
     constexpr inline Ret(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t mask      = 0xffff;
     constexpr static std::uint16_t compare   = 0x00ee;
@@ -160,8 +164,7 @@ struct Ret: public Instruction {
 
 struct Sys: public Instruction {
     constexpr inline Sys(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x0000;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -171,8 +174,7 @@ struct Sys: public Instruction {
 
 struct Jp: public Instruction {
     constexpr inline Jp(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare_1 = 0x1000;
     constexpr static std::uint16_t compare_2 = 0xb000;
@@ -184,8 +186,7 @@ struct Jp: public Instruction {
 
 struct Call: public Instruction {
     constexpr inline Call(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x2000;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -195,8 +196,7 @@ struct Call: public Instruction {
 
 struct Se: public Instruction {
     constexpr inline Se(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
 
     constexpr static std::uint16_t compare_1 = 0x3000;
@@ -209,8 +209,7 @@ struct Se: public Instruction {
 
 struct Sne: public Instruction {
     constexpr inline Sne(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare_1 = 0x4000;
     constexpr static std::uint16_t compare_2 = 0x9000;
@@ -222,8 +221,7 @@ struct Sne: public Instruction {
 
 struct Ld: public Instruction {
     constexpr inline Ld(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare_1 = 0x6000;
     constexpr static std::uint16_t compare_2 = 0x8000;
@@ -240,8 +238,7 @@ struct Ld: public Instruction {
 
 struct Add: public Instruction {
     constexpr inline Add(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare_1 = 0x7000;
     constexpr static std::uint16_t compare_2 = 0x8004;
@@ -254,8 +251,7 @@ struct Add: public Instruction {
 
 struct Or: public Instruction {
     constexpr inline Or(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8001;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -265,8 +261,7 @@ struct Or: public Instruction {
 
 struct And: public Instruction {
     constexpr inline And(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8002;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -276,8 +271,7 @@ struct And: public Instruction {
 
 struct Xor: public Instruction {
     constexpr inline Xor(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8003;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -287,8 +281,7 @@ struct Xor: public Instruction {
 
 struct Sub: public Instruction {
     constexpr inline Sub(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8005;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -298,8 +291,7 @@ struct Sub: public Instruction {
 
 struct Shr: public Instruction {
     constexpr inline Shr(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8006;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -309,8 +301,7 @@ struct Shr: public Instruction {
 
 struct Subn: public Instruction {
     constexpr inline Subn(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x8007;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -320,8 +311,7 @@ struct Subn: public Instruction {
 
 struct Shl: public Instruction {
     constexpr inline Shl(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0x800e;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -331,8 +321,7 @@ struct Shl: public Instruction {
 
 struct Rnd: public Instruction {
     constexpr inline Rnd(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0xc000;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -342,8 +331,7 @@ struct Rnd: public Instruction {
 
 struct Drw: public Instruction {
     constexpr inline Drw(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t compare   = 0xd000;
     constexpr static inline bool match(Opcode op) noexcept {
@@ -353,8 +341,7 @@ struct Drw: public Instruction {
 
 struct Skp: public Instruction {
     constexpr inline Skp(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t mask      = 0xf0ff;
     constexpr static std::uint16_t compare   = 0xe09e;
@@ -365,8 +352,7 @@ struct Skp: public Instruction {
 
 struct Sknp: public Instruction {
     constexpr inline Sknp(Opcode op) noexcept: Instruction(op) { }
-    virtual void execute(Chip8 &chip) const override;
-    virtual void print() const override;
+    virtual void print(std::FILE *fp = stdout) const override;
 
     constexpr static std::uint16_t mask      = 0xf0ff;
     constexpr static std::uint16_t compare   = 0xe0a1;
@@ -375,4 +361,165 @@ struct Sknp: public Instruction {
     }
 };
 
+// Distinct behaviours an opcode can decode to, along with their handler
+#define C8_KINDS(X)                                                                 \
+    X(Unknown, unknown)                                                             \
+    X(Cls,     cls)     X(Ret,    ret)     X(Sys,     sys)                          \
+    X(Jp,      jp)      X(JpV0,   jp_v0)   X(Call,    call)                         \
+    X(SeImm,   se_imm)  X(SeReg,  se_reg)  X(SneImm,  sne_imm) X(SneReg, sne_reg)   \
+    X(LdImm,   ld_imm)  X(LdReg,  ld_reg)  X(LdI,     ld_i)    X(LdDt,   ld_dt)     \
+    X(LdKey,   ld_key)  X(SetDt,  set_dt)  X(SetSt,   set_st)  X(LdFont, ld_font)   \
+    X(LdBcd,   ld_bcd)  X(LdStore,ld_store) X(LdLoad, ld_load)                      \
+    X(AddImm,  add_imm) X(AddReg, add_reg) X(AddI,    add_i)                        \
+    X(Or,      or_)     X(And,    and_)    X(Xor,     xor_)    X(Sub,    sub)       \
+    X(Shr,     shr)     X(Subn,   subn)    X(Shl,     shl)                          \
+    X(Rnd,     rnd)     X(Drw,    drw)     X(Skp,     skp)     X(Sknp,   sknp)
+
+enum class Kind: std::uint8_t {
+#define X(kind, fn) kind,
+    C8_KINDS(X)
+#undef X
+    Count,
+};
+
+constexpr inline Kind classify(Opcode op) noexcept {
+    switch ((op & 0xf000) >> 12) {
+        case 0:
+            if (Cls::match(op))
+                return Kind::Cls;
+            if (Ret::match(op))
+                return Kind::Ret;
+            return Kind::Sys;
+        case 1:   return Kind::Jp;
+        case 2:   return Kind::Call;
+        case 3:   return Kind::SeImm;
+        case 4:   return Kind::SneImm;
+        case 5:   return Se::match(op)  ? Kind::SeReg  : Kind::Unknown;
+        case 6:   return Kind::LdImm;
+        case 7:   return Kind::AddImm;
+        case 8:
+            switch (op & 0x000f) {
+                case 0:   return Kind::LdReg;
+                case 1:   return Kind::Or;
+                case 2:   return Kind::And;
+                case 3:   return Kind::Xor;
+                case 4:   return Kind::AddReg;
+                case 5:   return Kind::Sub;
+                case 6:   return Kind::Shr;
+                case 7:   return Kind::Subn;
+                case 0xe: return Kind::Shl;
+                default:  return Kind::Unknown;
+            }
+        case 9:   return Sne::match(op) ? Kind::SneReg : Kind::Unknown;
+        case 0xa: return Kind::LdI;
+        case 0xb: return Kind::JpV0;
+        case 0xc: return Kind::Rnd;
+        case 0xd: return Kind::Drw;
+        case 0xe:
+            if (Skp::match(op))
+                return Kind::Skp;
+            if (Sknp::match(op))
+                return Kind::Sknp;
+            return Kind::Unknown;
+        case 0xf:
+            switch (op & 0x00ff) {
+                case 0x07: return Kind::LdDt;
+                case 0x0a: return Kind::LdKey;
+                case 0x15: return Kind::SetDt;
+                case 0x18: return Kind::SetSt;
+                case 0x1e: return Kind::AddI;
+                case 0x29: return Kind::LdFont;
+                case 0x33: return Kind::LdBcd;
+                case 0x55: return Kind::LdStore;
+                case 0x65: return Kind::LdLoad;
+                default:   return Kind::Unknown;
+            }
+    }
+    return Kind::Unknown;
+}
+
+// Conditionally skips the next instruction
+constexpr inline bool is_skip(Kind kind) noexcept {
+    return kind == Kind::SeImm || kind == Kind::SeReg || kind == Kind::SneImm
+        || kind == Kind::SneReg || kind == Kind::Skp  || kind == Kind::Sknp;
+}
+
+using Handler = void (*)(Chip8 &chip, Opcode op);
+
+namespace impl {
+
+#define X(kind, fn) void fn(Chip8 &chip, Opcode op);
+    C8_KINDS(X)
+#undef X
+
+} // namespace impl
+
+// Built at compile time, indexed by raw opcode
+extern const std::array<Kind, 0x10000> kinds;
+
+constexpr inline std::array<Handler, static_cast<std::size_t>(Kind::Count)> handlers = {
+#define X(kind, fn) impl::fn,
+    C8_KINDS(X)
+#undef X
+};
+
+inline Kind decode(Opcode op) noexcept {
+    return kinds[op];
+}
+
+constexpr inline Handler handler(Kind kind) noexcept {
+    return handlers[static_cast<std::size_t>(kind)];
+}
+
+inline void execute(Chip8 &chip, Opcode op) {
+    handler(decode(op))(chip, op);
+}
+
+// Calls fn with a temporary of the class describing op, without allocating
+template <typename F>
+auto visit(Opcode op, F &&fn) {
+    switch (decode(op)) {
+        case Kind::Cls:     return fn(Cls(op));
+        case Kind::Ret:     return fn(Ret(op));
+        case Kind::Sys:     return fn(Sys(op));
+        case Kind::Jp:
+        case Kind::JpV0:    return fn(Jp(op));
+        case Kind::Call:    return fn(Call(op));
+        case Kind::SeImm:
+        case Kind::SeReg:   return fn(Se(op));
+        case Kind::SneImm:
+        case Kind::SneReg:  return fn(Sne(op));
+        case Kind::LdImm:
+        case Kind::LdReg:
+        case Kind::LdI:
+        case Kind::LdDt:
+        case Kind::LdKey:
+        case Kind::SetDt:
+        case Kind::SetSt:
+        case Kind::LdFont:
+        case Kind::LdBcd:
+        case Kind::LdStore:
+        case Kind::LdLoad:  return fn(Ld(op));
+        case Kind::AddImm:
+        case Kind::AddReg:
+        case Kind::AddI:    return fn(Add(op));
+        case Kind::Or:      return fn(Or(op));
+        case Kind::And:     return fn(And(op));
+        case Kind::Xor:     return fn(Xor(op));
+        case Kind::Sub:     return fn(Sub(op));
+        case Kind::Shr:     return fn(Shr(op));
+        case Kind::Subn:    return fn(Subn(op));
+        case Kind::Shl:     return fn(Shl(op));
+        case Kind::Rnd:     return fn(Rnd(op));
+        case Kind::Drw:     return fn(Drw(op));
+        case Kind::Skp:     return fn(Skp(op));
+        case Kind::Sknp:    return fn(Sknp(op));
+        default:            return fn(Instruction(op));
+    }
+}
+
+inline void print(Opcode op, std::FILE *fp = stdout) {
+    visit(op, [fp](const Instruction &instruction) { instruction.print(fp); });
+}
+
 } // namespace c8::ins
@@ -0,0 +1,537 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "chip8.hpp"
+#include "instruction.hpp"
+#include "utils.hpp"
+
+#include "jit.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+namespace c8::jit {
+
+#if defined(__x86_64__) && defined(__linux__)
+
+namespace {
+
+using ins::Kind;
+
+static_assert(offsetof(Registers, Vf) == 0xf, "V registers must be laid out first");
+
+constexpr std::uint8_t off_vf = offsetof(Registers, Vf);
+constexpr std::uint8_t off_i  = offsetof(Registers, I);
+constexpr std::uint8_t off_pc = offsetof(Registers, PC);
+constexpr std::uint8_t off_sp = offsetof(Registers, SP);
+constexpr std::uint8_t off_dt = offsetof(Registers, DT);
+constexpr std::uint8_t off_st = offsetof(Registers, ST);
+
+// Scratch registers, by encoding
+enum Scratch: std::uint8_t {
+    Eax = 0,
+    Ecx = 1,
+    Edx = 2,
+};
+
+// Blocks calling into the interpreter keep the Registers pointer in rbx and the Chip8 one in
+// r12, others (leaves) keep it in rsi where it is passed
+constexpr std::uint8_t rbx = 3, rsi = 6;
+
+// Registers available to hold V registers across the block: callee-saved ones around calls,
+// caller-saved ones in leaves, which then need no saving at all
+constexpr std::array<std::uint8_t, 4> pinnable      = { 5 /* rbp */, 13, 14, 15 };
+constexpr std::array<std::uint8_t, 4> pinnable_leaf = { 8, 9, 10, 11 };
+
+class Emitter {
+    public:
+        // Host register holding each V register, or -1 when it lives in memory
+        std::array<std::int8_t, 0x10> pins;
+
+        std::vector<std::uint8_t> &buf;
+
+        std::uint8_t  base  = rbx;  // Holds the Registers pointer
+        std::uint32_t calls = 0;    // Instructions that fell back to the interpreter
+        std::int32_t  stack = 0;    // Chip8::stack relative to the Registers
+
+        Emitter(std::vector<std::uint8_t> &buf): buf(buf) { }
+
+        void reset(bool leaf) {
+            this->pins.fill(-1);
+            this->buf.clear();
+            this->base  = leaf ? rsi : rbx;
+            this->calls = 0;
+        }
+
+        inline bool leaf() const {
+            return this->base == rsi;
+        }
+
+        template <typename ...Args>
+        void emit(Args ...args) {
+            (this->buf.push_back(static_cast<std::uint8_t>(args)), ...);
+        }
+
+        void imm16(std::uint16_t v) {
+            emit(v, v >> 8);
+        }
+
+        void imm32(std::uint32_t v) {
+            emit(v, v >> 8, v >> 16, v >> 24);
+        }
+
+        void imm64(std::uint64_t v) {
+            imm32(v), imm32(v >> 32);
+        }
+
+        constexpr static std::uint8_t modrm(std::uint8_t mod, std::uint8_t reg, std::uint8_t rm) {
+            return (mod << 6) | ((reg & 7) << 3) | (rm & 7);
+        }
+
+        // movzx s, Vx
+        void load(Scratch s, std::uint8_t v) {
+            if (auto h = this->pins[v]; h >= 0)
+                emit(0x40 | (h >> 3), 0x0f, 0xb6, modrm(3, s, h));
+            else
+                emit(0x0f, 0xb6, modrm(1, s, this->base), v);
+        }
+
+        // mov Vx, s8
+        void store(std::uint8_t v, Scratch s) {
+            if (auto h = this->pins[v]; h >= 0)
+                emit(0x40 | (h >> 3), 0x88, modrm(3, s, h));
+            else
+                emit(0x88, modrm(1, s, this->base), v);
+        }
+
+        // Write pinned registers back to memory
+        void spill() {
+            for (std::uint8_t v = 0; v < this->pins.size(); ++v) {
+                if (auto h = this->pins[v]; h >= 0)
+                    emit(0x40 | ((h >> 3) << 2), 0x88, modrm(1, h, this->base), v);
+            }
+        }
+
+        void reload() {
+            for (std::uint8_t v = 0; v < this->pins.size(); ++v) {
+                if (auto h = this->pins[v]; h >= 0)
+                    emit(0x40 | ((h >> 3) << 2), 0x0f, 0xb6, modrm(1, h, this->base), v);
+            }
+        }
+
+        // Leaves the masked stack slot in eax, for [base + rax * 2 + stack]
+        void stack_slot(std::int8_t delta) {
+            emit(0x0f, 0xb7, modrm(1, Eax, this->base), off_sp); // movzx eax, word [SP]
+            if (delta)
+                emit(0x83, 0xc0, delta);                // add eax, delta
+            emit(0x83, 0xe0, std::tuple_size_v<Stack> - 1); // and eax, size - 1
+        }
+
+        void stack_operand(Scratch s) {
+            emit(modrm(2, s, 4), (1 << 6) | (Eax << 3) | (this->base & 7)), imm32(this->stack);
+        }
+
+        // mov word [base + off], imm16
+        void store_word(std::uint8_t off, std::uint16_t v) {
+            emit(0x66, 0xc7, modrm(1, 0, this->base), off), imm16(v);
+        }
+
+        // Falls back to the interpreter
+        void call(ins::Opcode op) {
+            ++this->calls;
+            spill();
+            emit(0x4c, 0x89, 0xe7);                     // mov rdi, r12
+            emit(0xbe), imm32(op);                      // mov esi, op
+            emit(0x48, 0xb8), imm64(reinterpret_cast<std::uintptr_t>(ins::handler(ins::decode(op))));
+            emit(0xff, 0xd0);                           // call rax
+            reload();
+        }
+
+        // Saves rbx, r12 and the pinned registers, with rsp left 16-byte aligned for calls
+        void prologue() {
+            if (!this->leaf()) {
+                emit(0x53, 0x41, 0x54);                 // push rbx, r12
+                for (auto h: this->pins) {
+                    if (h >= 0)
+                        push(h);
+                }
+                if (!(this->saved() & 1))
+                    emit(0x48, 0x83, 0xec, 0x08);       // sub rsp, 8
+                emit(0x49, 0x89, 0xfc);                 // mov r12, rdi
+                emit(0x48, 0x89, 0xf3);                 // mov rbx, rsi
+            }
+            reload();
+        }
+
+        // Expects the retired instruction count in eax
+        void epilogue() {
+            spill();
+            if (!this->leaf()) {
+                if (!(this->saved() & 1))
+                    emit(0x48, 0x83, 0xc4, 0x08);       // add rsp, 8
+                for (auto h = this->pins.rbegin(); h != this->pins.rend(); ++h) {
+                    if (*h >= 0)
+                        pop(*h);
+                }
+                emit(0x41, 0x5c, 0x5b);                 // pop r12, rbx
+            }
+            emit(0xc3);                                 // ret
+        }
+
+        std::size_t saved() const {
+            return 2 + std::count_if(this->pins.begin(), this->pins.end(), [](auto h) { return h >= 0; });
+        }
+
+        void push(std::uint8_t h) {
+            if (h >> 3)
+                emit(0x41);
+            emit(0x50 | (h & 7));
+        }
+
+        void pop(std::uint8_t h) {
+            if (h >> 3)
+                emit(0x41);
+            emit(0x58 | (h & 7));
+        }
+
+        void body(Kind kind, ins::Opcode op) {
+            auto x = op.x(), y = op.y();
+            switch (kind) {
+                case Kind::Sys:
+                    break;
+                case Kind::LdImm:
+                    emit(0xb8), imm32(op.byte());       // mov eax, kk
+                    store(x, Eax);
+                    break;
+                case Kind::LdReg:
+                    load(Eax, y);
+                    store(x, Eax);
+                    break;
+                case Kind::AddImm:
+                    load(Eax, x);
+                    emit(0x05), imm32(op.byte());       // add eax, kk
+                    store(x, Eax);
+                    break;
+                case Kind::Or:
+                case Kind::And:
+                case Kind::Xor:
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit((kind == Kind::Or) ? 0x09 : (kind == Kind::And) ? 0x21 : 0x31, 0xc8); // op eax, ecx
+                    store(x, Eax);
+                    break;
+                case Kind::AddReg:
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x01, 0xc8);                   // add eax, ecx
+                    emit(0x89, 0xc2);                   // mov edx, eax
+                    emit(0xc1, 0xea, 0x08);             // shr edx, 8
+                    store(off_vf, Edx);
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x01, 0xc8);                   // add eax, ecx
+                    store(x, Eax);
+                    break;
+                case Kind::Sub:
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x39, 0xc8);                   // cmp eax, ecx
+                    emit(0x0f, 0x97, 0xc2);             // seta dl
+                    store(off_vf, Edx);
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x29, 0xc8);                   // sub eax, ecx
+                    store(x, Eax);
+                    break;
+                case Kind::Subn:
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x39, 0xc1);                   // cmp ecx, eax
+                    emit(0x0f, 0x97, 0xc2);             // seta dl
+                    store(off_vf, Edx);
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x29, 0xc1);                   // sub ecx, eax
+                    store(x, Ecx);
+                    break;
+                case Kind::Shr:
+                    load(Eax, x);
+                    emit(0x89, 0xc2);                   // mov edx, eax
+                    emit(0x83, 0xe2, 0x01);             // and edx, 1
+                    store(off_vf, Edx);
+                    load(Eax, x);
+                    emit(0xd1, 0xe8);                   // shr eax, 1
+                    store(x, Eax);
+                    break;
+                case Kind::Shl:
+                    load(Eax, x);
+                    emit(0x89, 0xc2);                   // mov edx, eax
+                    emit(0xc1, 0xea, 0x07);             // shr edx, 7
+                    emit(0x83, 0xe2, 0x01);             // and edx, 1
+                    store(off_vf, Edx);
+                    load(Eax, x);
+                    emit(0xd1, 0xe0);                   // shl eax, 1
+                    store(x, Eax);
+                    break;
+                case Kind::LdI:
+                    store_word(off_i, op.addr());
+                    break;
+                case Kind::AddI:
+                    load(Eax, x);
+                    emit(0x66, 0x01, modrm(1, Eax, this->base), off_i); // add [I], ax
+                    break;
+                case Kind::LdFont:
+                    load(Eax, x);
+                    emit(0x8d, 0x04, 0x80);             // lea eax, [rax + rax * 4]
+                    emit(0x66, 0x89, modrm(1, Eax, this->base), off_i); // mov [I], ax
+                    break;
+                case Kind::LdDt:
+                    emit(0x0f, 0xb6, modrm(1, Eax, this->base), off_dt); // movzx eax, [DT]
+                    store(x, Eax);
+                    break;
+                case Kind::SetDt:
+                case Kind::SetSt:
+                    load(Eax, x);
+                    emit(0x88, modrm(1, Eax, this->base), (kind == Kind::SetDt) ? off_dt : off_st);
+                    break;
+                default:
+                    call(op);
+                    break;
+            }
+        }
+
+        // Sets PC from the skip flag in dl, and the retired count in eax
+        void skip_tail(Address exit_pc, std::uint32_t length, bool fused, ins::Opcode jp) {
+            emit(0x0f, 0xb6, 0xd2);                     // movzx edx, dl
+            if (fused) {
+                emit(0xb8), imm32(jp.addr());           // mov eax, nnn
+                emit(0xb9), imm32(exit_pc + 4);         // mov ecx, exit + 4
+                emit(0x85, 0xd2);                       // test edx, edx
+                emit(0x0f, 0x45, 0xc1);                 // cmovnz eax, ecx
+                emit(0x66, 0x89, modrm(1, Eax, this->base), off_pc);
+                emit(0xb8), imm32(length + 2);          // mov eax, length + 2
+                emit(0x29, 0xd0);                       // sub eax, edx
+            } else {
+                emit(0x8d, 0x04, 0x55), imm32(exit_pc + 2); // lea eax, [rdx * 2 + exit + 2]
+                emit(0x66, 0x89, modrm(1, Eax, this->base), off_pc);
+                emit(0xb8), imm32(length + 1);
+            }
+        }
+
+        void exit(Kind kind, ins::Opcode op, Address exit_pc, std::uint32_t length, bool fused, ins::Opcode jp) {
+            auto x = op.x(), y = op.y();
+            switch (kind) {
+                case Kind::Jp:
+                    store_word(off_pc, op.addr());
+                    emit(0xb8), imm32(length + 1);
+                    break;
+                case Kind::JpV0:
+                    load(Eax, 0);
+                    emit(0x05), imm32(op.addr());       // add eax, nnn
+                    emit(0x66, 0x89, modrm(1, Eax, this->base), off_pc);
+                    emit(0xb8), imm32(length + 1);
+                    break;
+                case Kind::Call:
+                    stack_slot(0);
+                    emit(0x66, 0xc7), stack_operand(Eax), imm16(exit_pc); // mov word [stack + SP * 2], exit
+                    emit(0x83, 0xc0, 0x01);             // add eax, 1
+                    emit(0x83, 0xe0, std::tuple_size_v<Stack> - 1);
+                    emit(0x66, 0x89, modrm(1, Eax, this->base), off_sp);
+                    store_word(off_pc, op.addr());
+                    emit(0xb8), imm32(length + 1);
+                    break;
+                case Kind::Ret:
+                    stack_slot(-1);
+                    emit(0x66, 0x89, modrm(1, Eax, this->base), off_sp);
+                    emit(0x0f, 0xb7), stack_operand(Ecx); // movzx ecx, word [stack + SP * 2]
+                    emit(0x83, 0xc1, 0x02);             // add ecx, 2
+                    emit(0x66, 0x89, modrm(1, Ecx, this->base), off_pc);
+                    emit(0xb8), imm32(length + 1);
+                    break;
+                case Kind::SeImm:
+                case Kind::SneImm:
+                    load(Eax, x);
+                    emit(0x3d), imm32(op.byte());       // cmp eax, kk
+                    emit(0x0f, (kind == Kind::SeImm) ? 0x94 : 0x95, 0xc2); // sete/setne dl
+                    skip_tail(exit_pc, length, fused, jp);
+                    break;
+                case Kind::SeReg:
+                case Kind::SneReg:
+                    load(Eax, x);
+                    load(Ecx, y);
+                    emit(0x39, 0xc8);                   // cmp eax, ecx
+                    emit(0x0f, (kind == Kind::SeReg) ? 0x94 : 0x95, 0xc2);
+                    skip_tail(exit_pc, length, fused, jp);
+                    break;
+                case Kind::Skp:
+                case Kind::Sknp:
+                    store_word(off_pc, exit_pc);
+                    call(op);
+                    emit(0x66, 0x81, modrm(1, 7, this->base), off_pc), imm16(exit_pc); // cmp word [PC], exit
+                    emit(0x0f, 0x95, 0xc2);             // setne dl
+                    skip_tail(exit_pc, length, fused, jp);
+                    break;
+                default:
+                    store_word(off_pc, exit_pc);
+                    call(op);
+                    emit(0x66, 0x83, modrm(1, 0, this->base), off_pc, 0x02); // add word [PC], 2
+                    emit(0xb8), imm32(length + 1);
+                    break;
+            }
+        }
+};
+
+// Pins the most referenced V registers of the block
+void allocate(Emitter &e, Chip8 &chip, const blk::Block &block) {
+    auto &regs = e.leaf() ? pinnable_leaf : pinnable;
+
+    std::array<std::uint32_t, 0x10> refs{};
+    for (Address addr = block.start; addr < block.end; addr += sizeof(ins::Opcode)) {
+        auto op = chip.fetch(addr).op;
+        ++refs[op.x()], ++refs[op.y()];
+    }
+
+    std::array<std::uint8_t, 0x10> order;
+    for (std::uint8_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&refs](auto a, auto b) { return refs[a] > refs[b]; });
+
+    for (std::size_t i = 0; i < regs.size(); ++i) {
+        if (refs[order[i]] >= 2)
+            e.pins[order[i]] = regs[i];
+    }
+}
+
+void translate(Emitter &e, Chip8 &chip, const blk::Block &block) {
+    e.stack = reinterpret_cast<std::uint8_t *>(chip.stack.data()) - reinterpret_cast<std::uint8_t *>(&chip.regs);
+    allocate(e, chip, block);
+    e.prologue();
+
+    Address addr = block.start;
+    for (std::uint16_t i = 0; i < block.length; ++i, addr += sizeof(ins::Opcode)) {
+        auto &decoded = chip.fetch(addr);
+        e.body(decoded.kind, decoded.op);
+    }
+
+    if (block.exit.exit) {
+        auto &decoded = chip.fetch(block.exit_pc);
+        auto fused    = block.end == block.exit_pc + 2 * sizeof(ins::Opcode);
+        e.exit(decoded.kind, decoded.op, block.exit_pc, block.length, fused, block.exit.op2);
+    } else {
+        e.store_word(off_pc, block.exit_pc);
+        e.emit(0xb8), e.imm32(block.length);
+    }
+
+    e.epilogue();
+}
+
+} // namespace
+
+Compiler::Compiler(std::size_t size) {
+    int fd = memfd_create("c8-jit", MFD_CLOEXEC);
+    if (fd < 0) {
+        ERROR("Failed to create jit buffer\n");
+        return;
+    }
+
+    // The views outlive the descriptor
+    void *rw = MAP_FAILED, *rx = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        rw = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        rx = mmap(nullptr, size, PROT_READ | PROT_EXEC,  MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if ((rw == MAP_FAILED) || (rx == MAP_FAILED)) {
+        ERROR("Failed to map jit buffer\n");
+        if (rw != MAP_FAILED)
+            munmap(rw, size);
+        if (rx != MAP_FAILED)
+            munmap(rx, size);
+        return;
+    }
+
+    this->writable = static_cast<std::uint8_t *>(rw);
+    this->code     = static_cast<std::uint8_t *>(rx);
+    this->size     = size;
+}
+
+Compiler::~Compiler() {
+    if (this->code)
+        munmap(this->code, this->size), munmap(this->writable, this->size);
+}
+
+blk::Native Compiler::compile(Chip8 &chip, const blk::Block &block) {
+    // Try it as a leaf first, start over if anything had to call into the interpreter
+    Emitter e(this->scratch);
+    e.reset(true);
+    translate(e, chip, block);
+    if (e.calls) {
+        // Saving registers around the calls costs more than the block interpreter when
+        // they are most of the block
+        if (2 * e.calls >= block.size())
+            return nullptr;
+        e.reset(false);
+        translate(e, chip, block);
+    }
+
+    // Keep entry points aligned
+    auto start = (this->used + 0xf) & ~std::size_t(0xf);
+    if (!this->code)
+        return nullptr;
+    if (start + e.buf.size() > this->size) {
+        this->full = true;
+        return nullptr;
+    }
+
+    // x86 keeps instruction fetches coherent with stores through the other view
+    std::memcpy(this->writable + start, e.buf.data(), e.buf.size());
+
+    this->used = start + e.buf.size();
+    return reinterpret_cast<blk::Native>(this->code + start);
+}
+
+void Compiler::flush() noexcept {
+    this->used = 0;
+    this->full = false;
+}
+
+#else
+
+Compiler::Compiler(std::size_t size) {
+    UNUSED(size);
+}
+
+Compiler::~Compiler() = default;
+
+blk::Native Compiler::compile(Chip8 &chip, const blk::Block &block) {
+    UNUSED(chip); UNUSED(block);
+    return nullptr;
+}
+
+void Compiler::flush() noexcept { }
+
+#endif
+
+} // namespace c8::jit
@@ -0,0 +1,63 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "block.hpp"
+
+namespace c8::jit {
+
+#if defined(__x86_64__) && defined(__linux__)
+constexpr static bool available = true;
+#else
+constexpr static bool available = false;
+#endif
+
+// Translates blocks to x86-64 into a fixed-size code buffer, mapped twice so code is written
+// through one view and run from the other without changing protections
+class Compiler {
+    public:
+        Compiler(std::size_t size = default_size);
+        ~Compiler();
+
+        // Returns null when the block is better left to the block interpreter, or when the code
+        // buffer is full
+        blk::Native compile(Chip8 &chip, const blk::Block &block);
+
+        inline bool is_full() const noexcept {
+            return this->full;
+        }
+
+        // Discards every translation, callers must drop their pointers
+        void flush() noexcept;
+
+        constexpr static std::size_t default_size = 0x40000;
+
+    protected:
+        std::uint8_t *code = nullptr, *writable = nullptr;
+        std::size_t   size = 0, used = 0;
+        bool          full = false;
+
+        // Kept across translations so they don't allocate
+        std::vector<std::uint8_t> scratch;
+};
+
+} // namespace c8::jit
@@ -15,40 +15,128 @@
 // You should have received a copy of the GNU General Public License
 // along with c8.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cinttypes>
+#include <csignal>
 #include <cstring>
 #include <chrono>
 #include <curses.h>
-#include <signal.h>
+#include <getopt.h>
 #include <unistd.h>
 #include <SDL.h>
 
-#ifdef __MINGW32__
-#   include <synchapi.h>
-#endif
-
 #include "chip8.hpp"
+#include "disasm.hpp"
+#include "perf.hpp"
+#include "profiler.hpp"
+#include "rewind.hpp"
 #include "rom.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
-using namespace std::chrono_literals;
+static volatile std::sig_atomic_t should_stop = false;
 
 static inline void print_usage([[maybe_unused]] char *progname) {
-    FATAL("Usage: %s [-d] rom\n", progname);
+    FATAL("Usage: %s [-d] [-b|-j|-a] [-H] [-n instructions] [-f frames] [-i ipf] [-s speed] [-S state] [-r state] [-R seconds] [-m movie|-p movie] [-e seed] [-P] [-C] [-t trace] [--compile out.cpp] rom\n", progname);
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, char **argv) {
-    char *rom_path = nullptr;
-    bool disassemble = false;
+    char *rom_path = nullptr, *compile_path = nullptr, *state_path = nullptr, *restore_path = nullptr;
+    char *record_path = nullptr, *replay_path = nullptr, *trace_path = nullptr;
+    bool disassemble = false, headless = false, profile = false, count_events = false;
+    std::uint64_t budget = 0, frame_budget = 0, seed = 0;
+    bool seeded = false;
+    std::uint32_t ipf = c8::sched::default_ipf, rewind = 0;
+    double speed = 1;
+    auto mode = c8::Chip8::Mode::Interpreter;
 
     INFO("Starting\n");
 
+    static const struct option long_options[] = {
+        { "disassemble", no_argument,       nullptr, 'd' },
+        { "block",       no_argument,       nullptr, 'b' },
+        { "jit",         no_argument,       nullptr, 'j' },
+        { "aot",         no_argument,       nullptr, 'a' },
+        { "compile",     required_argument, nullptr, 'c' },
+        { "headless",    no_argument,       nullptr, 'H' },
+        { "budget",      required_argument, nullptr, 'n' },
+        { "frames",      required_argument, nullptr, 'f' },
+        { "ipf",         required_argument, nullptr, 'i' },
+        { "speed",       required_argument, nullptr, 's' },
+        { "state",       required_argument, nullptr, 'S' },
+        { "restore",     required_argument, nullptr, 'r' },
+        { "rewind",      required_argument, nullptr, 'R' },
+        { "record",      required_argument, nullptr, 'm' },
+        { "replay",      required_argument, nullptr, 'p' },
+        { "seed",        required_argument, nullptr, 'e' },
+        { "profile",     no_argument,       nullptr, 'P' },
+        { "counters",    no_argument,       nullptr, 'C' },
+        { "trace",       required_argument, nullptr, 't' },
+        { nullptr,       0,                 nullptr, 0   },
+    };
+
     int opt;
-    while ((opt = getopt(argc, argv, "d")) != -1) {
+    while ((opt = getopt_long(argc, argv, "dbjac:Hn:f:i:s:S:r:R:m:p:e:PCt:", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'd':
                 disassemble = true;
                 break;
+            case 'b':
+                mode = c8::Chip8::Mode::Block;
+                break;
+            case 'j':
+                mode = c8::Chip8::Mode::Jit;
+                break;
+            case 'a':
+                mode = c8::Chip8::Mode::Aot;
+                break;
+            case 'c':
+                compile_path = optarg;
+                break;
+            case 'H':
+                headless = true;
+                break;
+            case 'n':
+                budget = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 'f':
+                frame_budget = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 'i':
+                ipf = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 's':
+                speed = std::strtod(optarg, nullptr);
+                break;
+            case 'S':
+                state_path = optarg;
+                break;
+            case 'r':
+                restore_path = optarg;
+                break;
+            case 'R':
+                rewind = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 'm':
+                record_path = optarg;
+                break;
+            case 'p':
+                replay_path = optarg;
+                break;
+            case 'e':
+                seed   = std::strtoull(optarg, nullptr, 0);
+                seeded = true;
+                break;
+            case 'P':
+                profile = true;
+                break;
+            case 'C':
+                count_events = true;
+                break;
+            case 't':
+                trace_path = optarg;
+                break;
             default:
                 print_usage(argv[0]);
         }
@@ -68,24 +156,163 @@ int main(int argc, char **argv) {
 
     if (disassemble) {
         INFO("Disassembling:\n");
-        std::uint16_t address = c8::ProgramStart;
-        for (auto &op: *rom.get_code()) {
-            printf("  %04x: %04x -> ", address, __builtin_bswap16(op));
-            address += sizeof(c8::ins::Opcode);
-            c8::Chip8::decode(c8::ins::Opcode(__builtin_bswap16(op)))->print();
+        c8::Ram ram{};
+        c8::Chip8::load(ram, *rom.get_code());
+        c8::dis::disassemble(stdout, ram.data(), rom.get_code()->size());
+        std::fflush(stdout);
+    }
+
+    if (compile_path) {
+        auto *fp = std::fopen(compile_path, "w");
+        if (!fp) {
+            FATAL("Failed to open %s\n", compile_path);
+            return EXIT_FAILURE;
+        }
+
+        c8::Ram ram{};
+        c8::Chip8::load(ram, *rom.get_code());
+        auto *name = std::strrchr(rom_path, '/');
+        bool ok = c8::aot::generate(fp, ram.data(), ram.size() - c8::ProgramStart, name ? name + 1 : rom_path);
+        ok &= !std::fclose(fp);
+        if (!ok) {
+            FATAL("Failed to write %s\n", compile_path);
+            return EXIT_FAILURE;
         }
+
+        INFO("Wrote %s\n", compile_path);
+        return EXIT_SUCCESS;
     }
 
-    constexpr auto sleep_duration = 5ms;
+    // Movies start from boot
+    if ((record_path && (replay_path || restore_path)) || (replay_path && restore_path))
+        print_usage(argv[0]);
+    if (record_path && rewind) {
+        std::fprintf(stderr, "Rewinding is disabled while recording\n");
+        return EXIT_FAILURE;
+    }
+
+    // Only the interpreter goes through the profiling and tracing hooks
+    if (profile && !c8::prof::enabled) {
+        std::fprintf(stderr, "Profiling is not built in, rebuild with make PROFILE=1\n");
+        return EXIT_FAILURE;
+    }
+    if (profile || trace_path)
+        mode = c8::Chip8::Mode::Interpreter;
+
+    c8::script::Movie movie;
+    if (replay_path) {
+        if (!c8::script::load(replay_path, movie)) {
+            std::fprintf(stderr, "Failed to load movie %s\n", replay_path);
+            return EXIT_FAILURE;
+        }
+        ipf    = movie.ipf ? movie.ipf : ipf;
+        budget = budget ? budget : movie.length;
+        // Live keys would mix with the recorded ones
+        headless = true;
+    }
+    c8::script::Player player(movie.script);
+
+    std::signal(SIGINT, +[](int) { should_stop = true; });
+
+    std::uint64_t executed = 0, frames = 0;
+    std::size_t history_frames = 0, history_bytes = 0;
+    std::uint64_t hash = 0;
+    std::unique_ptr<c8::prof::Profiler> profiler;
+    c8::Ram ram;
+
+    // Only counts the emulation thread in user space, so neither rendering nor pacing sleeps
+    std::unique_ptr<c8::perf::Counters> counters;
+    c8::perf::Values events{};
+    if (count_events)
+        counters = std::make_unique<c8::perf::Counters>();
+    auto start = std::chrono::steady_clock::now();
+    {
+        // Headless runs go as fast as the host allows, others are paced by the scheduler
+        auto chip = c8::Chip8(rom.get_code(), mode, headless, ipf);
+        chip.scheduler.set_speed(speed);
+        chip.snapshot_path = state_path ? state_path : std::string(rom_path) + ".state";
+        if (rewind)
+            chip.history = std::make_unique<c8::rwd::History>(rewind * c8::sched::frame_rate);
+        if (profile)
+            chip.profiler = std::make_unique<c8::prof::Profiler>(count_events);
+
+        if (replay_path)
+            chip.seed(movie.seed);
+        else if (seeded)
+            chip.seed(seed);
+        if (record_path) {
+            chip.movie = std::make_unique<c8::script::Movie>();
+            chip.movie->seed = chip.get_seed();
+            chip.movie->ipf  = chip.scheduler.get_ipf();
+        }
+
+        if (restore_path) {
+            c8::snap::State state;
+            if (!c8::snap::read(restore_path, state)) {
+                std::fprintf(stderr, "Failed to restore %s\n", restore_path);
+                return EXIT_FAILURE;
+            }
+            chip.restore(state);
+        }
+
+        if (trace_path) {
+            chip.tracer = c8::trace::Writer::open(trace_path, chip.scheduler.cycles);
+            if (!chip.tracer) {
+                std::fprintf(stderr, "Failed to open %s\n", trace_path);
+                return EXIT_FAILURE;
+            }
+        }
+
+        // Budgets count from the restored point
+        auto first_frame = chip.scheduler.frames;
+        if (counters)
+            counters->enable();
+        while (!should_stop && (!budget || (executed < budget)) && (!frame_budget || (frames < frame_budget))) {
+            auto limit = std::min<std::uint64_t>(budget ? budget - executed : SIZE_MAX, player.feed(chip));
+            executed += chip.run_frame(limit);
+            frames    = chip.scheduler.frames - first_frame;
+        }
+        if (counters) {
+            counters->disable();
+            events = counters->read();
+        }
+
+        hash = chip.hash();
+        if (chip.tracer && !chip.tracer->finish()) {
+            std::fprintf(stderr, "Failed to write trace %s\n", trace_path);
+            return EXIT_FAILURE;
+        }
+        chip.ram.copy_to(ram.data());
+        profiler = std::move(chip.profiler);
+        if (chip.movie) {
+            chip.movie->length = chip.scheduler.cycles;
+            if (!c8::script::save(record_path, *chip.movie)) {
+                std::fprintf(stderr, "Failed to write movie %s\n", record_path);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (chip.history)
+            history_frames = chip.history->frames(), history_bytes = chip.history->bytes();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::printf("Executed %" PRIu64 " instructions (%" PRIu64 " frames) in %.3fs (%.0f instructions/s)\n",
+        executed, frames, elapsed.count(), executed / elapsed.count());
+
+    if (record_path || replay_path)
+        std::printf("State hash: %016" PRIx64 "\n", hash);
+
+    if (counters)
+        c8::perf::report(*counters, events, executed);
+
+    if (profiler)
+        profiler->report(ram.data());
 
-    auto chip = c8::Chip8(rom.get_code());
-    while (true) {
-        chip.cycle();
-#ifdef __MINGW32__
-        Sleep(sleep_duration.count()); // For some reason std::this_thread::sleep_for on windows is unreliable
-#else
-        std::this_thread::sleep_for(sleep_duration);
-#endif
+    if (history_frames) {
+        auto minutes = double(history_frames) / (60 * c8::sched::frame_rate);
+        std::printf("Rewind history: %zu frames in %.1f KiB (%.1f KiB per minute)\n",
+            history_frames, history_bytes / 1024.0, history_bytes / 1024.0 / minutes);
     }
 
     return EXIT_SUCCESS;
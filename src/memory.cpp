@@ -0,0 +1,68 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+
+#include "utils.hpp"
+
+#include "memory.hpp"
+
+namespace c8::mem {
+
+template class Paged<std::uint8_t>;
+
+void Memory::assign(const std::uint8_t *bytes) {
+    for (std::size_t i = 0; i < page_count; ++i, bytes += page_size) {
+        auto &page = this->pages[i];
+        if (!std::memcmp(page->data(), bytes, page_size))
+            continue;
+
+        if (std::all_of(bytes, bytes + page_size, [](auto byte) { return !byte; })) {
+            page = blank();
+            this->owned &= ~(1u << i);
+        } else {
+            this->own(i);
+            std::memcpy(page->data(), bytes, page_size);
+        }
+    }
+}
+
+void Memory::write(std::size_t addr, const std::uint8_t *bytes, std::size_t count) {
+    while (count) {
+        addr &= size - 1;
+        auto index  = addr / page_size, offset = addr % page_size;
+        auto length = std::min(count, page_size - offset);
+        if (!(this->owned & (1u << index)))
+            this->own(index);
+        std::copy_n(bytes, length, this->pages[index]->data() + offset);
+        addr += length, bytes += length, count -= length;
+    }
+}
+
+void Memory::copy_to(std::uint8_t *bytes) const noexcept {
+    for (auto &page: this->pages)
+        bytes = std::copy(page->begin(), page->end(), bytes);
+}
+
+std::uint64_t Memory::hash(std::uint64_t seed) const noexcept {
+    for (auto &page: this->pages)
+        seed = utils::fnv1a(page->data(), page_size, seed);
+    return seed;
+}
+
+} // namespace c8::mem
@@ -0,0 +1,149 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+
+namespace c8::mem {
+
+constexpr inline std::size_t size       = 0x1000;
+constexpr inline std::size_t page_size  = 0x100;
+constexpr inline std::size_t page_count = size / page_size;
+
+// Array of size entries split in pages of Length that copies share until one of them writes
+// there, blank pages are shared process-wide. Only the owner may copy or write it, copies can
+// then live on other threads
+template <typename T, std::size_t Length = page_size>
+class Paged {
+    public:
+        using Page = std::array<T, Length>;
+
+        // All value-initialized
+        Paged() {
+            this->pages.fill(blank());
+        }
+
+        // Copies share every page, the source included can no longer assume it owns any
+        Paged(const Paged &other): pages(other.pages) {
+            other.owned = 0;
+        }
+
+        Paged &operator =(const Paged &other) {
+            this->pages = other.pages;
+            this->owned = other.owned = 0;
+            return *this;
+        }
+
+        inline const T &operator [](std::size_t index) const noexcept {
+            index &= size - 1;
+            return (*this->pages[index / Length])[index % Length];
+        }
+
+        // Writable entry, the page gets copied first if it is shared
+        inline T &at(std::size_t index) {
+            index &= size - 1;
+            auto page = index / Length;
+            if (!(this->owned & (1u << page)))
+                this->own(page);
+            return (*this->pages[page])[index % Length];
+        }
+
+        // Back to all value-initialized
+        void clear() noexcept {
+            this->pages.fill(blank());
+            this->owned = 0;
+        }
+
+        // Pages not shared with any other copy
+        std::size_t owned_pages() const noexcept {
+            return std::count_if(this->pages.begin(), this->pages.end(), [](auto &page) { return page.use_count() == 1; });
+        }
+
+    protected:
+        static const std::shared_ptr<Page> &blank() {
+            static auto page = std::make_shared<Page>();
+            return page;
+        }
+
+        // Copies the page unless nothing else holds it
+        void own(std::size_t index);
+
+    protected:
+        std::array<std::shared_ptr<Page>, size / Length> pages;
+
+        // Pages known to be held by this copy alone, spares the reference count check on writes
+        mutable std::uint32_t owned = 0;
+        static_assert(size / Length <= 32);
+};
+
+// Out of line so that writes stay small enough to inline, instantiated by each user
+template <typename T, std::size_t Length>
+void Paged<T, Length>::own(std::size_t index) {
+    auto &page = this->pages[index];
+    if (page.use_count() != 1)
+        page = std::make_shared<Page>(*page);
+    else // Pairs with the release of the last other holder dropping it, after its last reads
+        std::atomic_thread_fence(std::memory_order_acquire);
+    this->owned |= 1u << index;
+}
+
+extern template class Paged<std::uint8_t>;
+
+using Page = Paged<std::uint8_t>::Page;
+
+// Machine memory
+class Memory: public Paged<std::uint8_t> {
+    public:
+        inline std::uint8_t operator [](std::size_t addr) const noexcept {
+            return Paged::operator [](addr);
+        }
+
+        // Copies count bytes starting at addr, wrapping around the address space
+        inline void read(std::size_t addr, std::uint8_t *out, std::size_t count) const noexcept {
+            while (count) {
+                addr &= size - 1;
+                auto offset = addr % page_size;
+                auto length = std::min(count, page_size - offset);
+                std::copy_n(this->pages[addr / page_size]->data() + offset, length, out);
+                addr += length, out += length, count -= length;
+            }
+        }
+
+        inline void set(std::size_t addr, std::uint8_t value) {
+            this->at(addr) = value;
+        }
+
+        // Stores count bytes starting at addr, wrapping around the address space
+        void write(std::size_t addr, const std::uint8_t *bytes, std::size_t count);
+
+        // Replaces the contents with size bytes, pages that did not change stay shared
+        void assign(const std::uint8_t *bytes);
+
+        // Flattens the contents into size bytes
+        void copy_to(std::uint8_t *bytes) const noexcept;
+
+        // Same digest as utils::fnv1a over the flattened contents
+        std::uint64_t hash(std::uint64_t seed) const noexcept;
+};
+
+} // namespace c8::mem
@@ -0,0 +1,162 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "utils.hpp"
+
+#include "perf.hpp"
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+namespace c8::perf {
+
+#ifdef __linux__
+
+namespace {
+
+constexpr std::array<std::uint64_t, EventCount> configs = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+} // namespace
+
+Counters::Counters() {
+    this->fds.fill(-1);
+    this->index.fill(-1);
+
+    for (std::size_t i = 0; i < EventCount; ++i) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = configs[i];
+        attr.disabled       = this->leader < 0; // The group follows its leader
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, this->leader, 0);
+        if (fd < 0) {
+            TRACE("Counter %zu unavailable: %s\n", i, std::strerror(errno));
+            continue;
+        }
+
+        if (this->leader < 0)
+            this->leader = fd;
+        this->fds[i]   = fd;
+        this->index[i] = this->count++;
+    }
+}
+
+Counters::~Counters() {
+    for (auto fd: this->fds) {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void Counters::enable() noexcept {
+    if (this->any())
+        ioctl(this->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void Counters::disable() noexcept {
+    if (this->any())
+        ioctl(this->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+Values Counters::read() const noexcept {
+    Values values{};
+    if (!this->any())
+        return values;
+
+    // { nr, values[nr] }
+    std::array<std::uint64_t, EventCount + 1> buf;
+    if (::read(this->leader, buf.data(), sizeof(buf)) < 0)
+        return values;
+
+    for (std::size_t i = 0; i < EventCount; ++i) {
+        if (this->has(static_cast<Event>(i)))
+            values[i] = buf[1 + this->index[i]];
+    }
+    return values;
+}
+
+#else
+
+Counters::Counters() {
+    this->fds.fill(-1);
+    this->index.fill(-1);
+}
+
+Counters::~Counters() = default;
+
+void Counters::enable() noexcept { }
+
+void Counters::disable() noexcept { }
+
+Values Counters::read() const noexcept {
+    return {};
+}
+
+#endif
+
+void report(const Counters &counters, const Values &values, std::uint64_t executed) {
+    if (!counters.any()) {
+        std::printf("Hardware counters unavailable on this host\n");
+        return;
+    }
+    if (!executed)
+        return;
+
+    std::printf("Host counters:\n");
+    auto per_instruction = [&](Event event, const char *name) {
+        if (counters.has(event))
+            std::printf("  %-14s %14" PRIu64 " (%.2f per emulated instruction)\n", name, values[event], double(values[event]) / executed);
+    };
+    per_instruction(Cycles,       "cycles");
+    per_instruction(Instructions, "instructions");
+    per_instruction(Branches,     "branches");
+    per_instruction(CacheMisses,  "cache-misses");
+
+    if (counters.has(BranchMisses)) {
+        std::printf("  %-14s %14" PRIu64 " (%.2f per emulated instruction", "branch-misses", values[BranchMisses],
+            double(values[BranchMisses]) / executed);
+        if (counters.has(Branches) && values[Branches])
+            std::printf(", %.2f%% of branches", 100.0 * values[BranchMisses] / values[Branches]);
+        std::printf(")\n");
+    }
+
+    if (counters.has(Cycles) && counters.has(Instructions) && values[Cycles])
+        std::printf("  IPC %.2f\n", double(values[Instructions]) / values[Cycles]);
+}
+
+} // namespace c8::perf
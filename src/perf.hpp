@@ -0,0 +1,79 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+namespace c8::perf {
+
+#ifdef __linux__
+constexpr static bool available = true;
+#else
+constexpr static bool available = false;
+#endif
+
+enum Event: std::size_t {
+    Cycles,
+    Instructions,
+    Branches,
+    BranchMisses,
+    CacheMisses,
+    EventCount,
+};
+
+using Values = std::array<std::uint64_t, EventCount>;
+
+// Host hardware counters of the calling thread, user space only, through perf_event_open.
+// Events the host refuses (no PMU in most VMs, perf_event_paranoid) read as 0
+class Counters {
+    public:
+        Counters();
+        ~Counters();
+
+        Counters(const Counters &) = delete;
+        Counters &operator =(const Counters &) = delete;
+
+        inline bool has(Event event) const noexcept {
+            return this->index[event] >= 0;
+        }
+
+        inline bool any() const noexcept {
+            return this->leader >= 0;
+        }
+
+        // Counting only happens between the two
+        void enable() noexcept;
+        void disable() noexcept;
+
+        // Totals since opening, one syscall for every event
+        Values read() const noexcept;
+
+    protected:
+        int                           leader = -1;
+        std::array<int, EventCount>   fds;
+        std::array<int, EventCount>   index; // Position in the group read, -1 when not counted
+        int                           count = 0;
+};
+
+// Ratios per emulated instruction and misprediction rate
+void report(const Counters &counters, const Values &values, std::uint64_t executed);
+
+} // namespace c8::perf
@@ -0,0 +1,108 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+
+#include "pool.hpp"
+
+namespace c8::pool {
+
+Pool::Pool(std::size_t workers) {
+    workers = std::max<std::size_t>(workers, 1);
+    for (std::size_t i = 0; i < workers; ++i)
+        this->queues.push_back(std::make_unique<Queue>());
+    for (std::size_t i = 0; i < workers; ++i)
+        this->threads.emplace_back(&Pool::run, this, i);
+}
+
+Pool::~Pool() {
+    this->wait();
+    {
+        std::lock_guard lk(this->mtx);
+        this->should_stop = true;
+    }
+    this->work_cv.notify_all();
+    for (auto &thread: this->threads)
+        thread.join();
+}
+
+void Pool::submit(Task &&task) {
+    // Pushed before it is published, so a woken worker always finds it
+    {
+        auto &queue = *this->queues[this->next.fetch_add(1, std::memory_order_relaxed) % this->queues.size()];
+        std::lock_guard lk(queue.mtx);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard lk(this->mtx);
+        ++this->published, ++this->pending;
+    }
+    this->work_cv.notify_one();
+}
+
+void Pool::wait() {
+    std::unique_lock lk(this->mtx);
+    this->done_cv.wait(lk, [this] { return !this->pending; });
+}
+
+bool Pool::pop(std::size_t self, Task &task) {
+    for (std::size_t i = 0; i < this->queues.size(); ++i) {
+        auto &queue = *this->queues[(self + i) % this->queues.size()];
+        std::lock_guard lk(queue.mtx);
+        if (queue.tasks.empty())
+            continue;
+
+        if (!i) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void Pool::run(std::size_t self) {
+    std::unique_lock lk(this->mtx);
+    while (true) {
+        // Every task published up to here is visible to pop, later ones bump the count
+        auto seen = this->published;
+        lk.unlock();
+
+        Task task;
+        bool found = this->pop(self, task);
+        if (found)
+            task();
+
+        lk.lock();
+        if (found) {
+            if (!--this->pending)
+                this->done_cv.notify_all();
+            continue;
+        }
+
+        this->work_cv.wait(lk, [&] { return (this->published != seen) || this->should_stop; });
+        if (this->should_stop)
+            return;
+    }
+}
+
+} // namespace c8::pool
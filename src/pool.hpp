@@ -0,0 +1,71 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace c8::pool {
+
+// Work-stealing thread pool: every worker drains its own queue from the back,
+// then steals from the front of the others
+class Pool {
+    public:
+        using Task = std::function<void()>;
+
+        Pool(std::size_t workers = std::thread::hardware_concurrency());
+        ~Pool();
+
+        void submit(Task &&task);
+
+        // Blocks until every submitted task has completed
+        void wait();
+
+        inline std::size_t size() const noexcept {
+            return this->threads.size();
+        }
+
+    protected:
+        struct Queue {
+            std::mutex       mtx;
+            std::deque<Task> tasks;
+        };
+
+        bool pop(std::size_t self, Task &task);
+        void run(std::size_t self);
+
+    protected:
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread>            threads;
+
+        std::mutex              mtx;
+        std::condition_variable work_cv, done_cv;
+        std::size_t             published = 0, pending = 0; // Guarded by mtx
+        std::atomic_size_t      next = 0;
+        bool                    should_stop = false;
+};
+
+} // namespace c8::pool
@@ -0,0 +1,119 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+#include "chip8.hpp"
+
+#include "profiler.hpp"
+
+namespace c8::prof {
+
+namespace {
+
+const char *kind_name(ins::Kind kind) {
+    switch (kind) {
+#define X(kind, fn) case ins::Kind::kind: return #kind;
+        C8_KINDS(X)
+#undef X
+        default: return "?";
+    }
+}
+
+// Indices of the non-zero counters, most time first
+template <std::size_t N>
+std::vector<std::size_t> sorted(const std::array<Counter, N> &counters) {
+    std::vector<std::size_t> indices;
+    for (std::size_t i = 0; i < N; ++i) {
+        if (counters[i].count)
+            indices.push_back(i);
+    }
+    std::stable_sort(indices.begin(), indices.end(),
+        [&](auto lhs, auto rhs) { return counters[lhs].time > counters[rhs].time; });
+    return indices;
+}
+
+void print_row(const char *label, const Counter &counter, std::uint64_t total, std::chrono::nanoseconds total_time) {
+    std::printf("  %-8s %12" PRIu64 " %6.2f%% %10.3fms %6.2f%% %7.1fns ", label, counter.count,
+        100.0 * counter.count / total, counter.time.count() / 1e6,
+        total_time.count() ? 100.0 * counter.time.count() / total_time.count() : 0.0,
+        double(counter.time.count()) / counter.count);
+}
+
+} // namespace
+
+Profiler::Profiler(bool counters) {
+    if (!counters)
+        return;
+
+    this->counters = std::make_unique<perf::Counters>();
+    if (!this->counters->any()) {
+        this->counters.reset();
+        return;
+    }
+
+    // Smallest cost of an empty measurement, per event
+    this->counters->enable();
+    this->overhead.fill(UINT64_MAX);
+    for (int i = 0; i < 64; ++i) {
+        auto before = this->counters->read(), after = this->counters->read();
+        for (std::size_t j = 0; j < perf::EventCount; ++j)
+            this->overhead[j] = std::min(this->overhead[j], after[j] - before[j]);
+    }
+}
+
+Profiler::~Profiler() = default;
+
+void Profiler::report(const std::uint8_t *mem, std::size_t top) const {
+    auto total = std::accumulate(this->kinds.begin(), this->kinds.end(), Counter{}, [](auto acc, auto &counter) {
+        return Counter{ acc.count + counter.count, acc.time + counter.time };
+    });
+    if (!total.count)
+        return;
+
+    std::printf("Profile: %" PRIu64 " interpreted instructions in %.3fms\n", total.count, total.time.count() / 1e6);
+    std::printf("  %-8s %12s %7s %12s %7s %9s%s\n", "class", "count", "", "time", "", "per ins",
+        this->counters ? "  host ins   br-miss" : "");
+    for (auto i: sorted(this->kinds)) {
+        print_row(kind_name(static_cast<ins::Kind>(i)), this->kinds[i], total.count, total.time);
+        if (this->counters) {
+            auto &events = this->kind_events[i];
+            std::printf("%9.1f %8.2f%%", double(events[perf::Instructions]) / this->kinds[i].count,
+                events[perf::Branches] ? 100.0 * events[perf::BranchMisses] / events[perf::Branches] : 0.0);
+        }
+        std::printf("\n");
+    }
+
+    std::printf("Hot addresses:\n");
+    auto addresses = sorted(this->addresses);
+    addresses.resize(std::min(addresses.size(), top));
+    for (auto addr: addresses) {
+        char label[8];
+        std::snprintf(label, sizeof(label), "%03zx", addr);
+        auto op = ins::Opcode(mem[addr] << 8 | mem[(addr + 1) & address_mask]);
+        print_row(label, this->addresses[addr], total.count, total.time);
+        std::printf("%04x -> ", static_cast<std::uint16_t>(op));
+        Chip8::decode(op)->print();
+    }
+}
+
+} // namespace c8::prof
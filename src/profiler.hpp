@@ -0,0 +1,93 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <memory>
+
+#include "instruction.hpp"
+#include "perf.hpp"
+
+namespace c8::prof {
+
+// Built with make PROFILE=1, otherwise every hook compiles away
+#ifdef C8_PROFILE
+constexpr inline bool enabled = true;
+#else
+constexpr inline bool enabled = false;
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Counter {
+    std::uint64_t            count = 0;
+    std::chrono::nanoseconds time{};
+};
+
+// Executions and host time of interpreted instructions, per opcode class and per address
+class Profiler {
+    public:
+        // With counters, host hardware events are also attributed to each opcode class. Reading them
+        // around every instruction is slow and disturbs the branch predictor, the cost of the reads
+        // themselves is measured once and subtracted
+        Profiler(bool counters = false);
+        ~Profiler();
+
+        // Around the handler of each instruction
+        inline void begin() noexcept {
+            if (this->counters)
+                this->before = this->counters->read();
+            this->start = Clock::now();
+        }
+
+        inline void end(std::uint16_t pc, ins::Kind kind) noexcept {
+            auto time = Clock::now() - this->start;
+
+            auto &by_kind = this->kinds[static_cast<std::size_t>(kind)];
+            ++by_kind.count, by_kind.time += time;
+            auto &by_pc = this->addresses[pc & (this->addresses.size() - 1)];
+            ++by_pc.count, by_pc.time += time;
+
+            if (this->counters) {
+                auto after = this->counters->read();
+                auto &events = this->kind_events[static_cast<std::size_t>(kind)];
+                for (std::size_t i = 0; i < perf::EventCount; ++i) {
+                    auto delta = after[i] - this->before[i];
+                    events[i] += (delta > this->overhead[i]) ? delta - this->overhead[i] : 0;
+                }
+            }
+        }
+
+        // Prints both tables sorted by time, the top addresses disassembled from mem
+        void report(const std::uint8_t *mem, std::size_t top = 20) const;
+
+    protected:
+        std::array<Counter, static_cast<std::size_t>(ins::Kind::Count)>      kinds{};
+        std::array<Counter, 0x1000>                                          addresses{};
+
+        std::unique_ptr<perf::Counters>                                      counters;
+        perf::Values                                                         before{}, overhead{};
+        std::array<perf::Values, static_cast<std::size_t>(ins::Kind::Count)> kind_events{};
+        Clock::time_point                                                    start{};
+};
+
+} // namespace c8::prof
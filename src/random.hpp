@@ -0,0 +1,57 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+
+namespace c8::rng {
+
+// xorshift64*, one per machine so parallel instances neither share nor race on a sequence
+class Generator {
+    public:
+        Generator(std::uint64_t seed = 0) noexcept {
+            this->seed(seed);
+        }
+
+        // Scrambled through splitmix64 so nearby seeds give unrelated sequences and the state is never 0
+        inline void seed(std::uint64_t seed) noexcept {
+            auto z = seed + 0x9e3779b97f4a7c15;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            z ^= z >> 31;
+            this->state = z ? z : 1;
+        }
+
+        inline std::uint64_t next() noexcept {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+            return this->state * 0x2545f4914f6cdd1d;
+        }
+
+        // High bits are the best distributed
+        inline std::uint8_t byte() noexcept {
+            return this->next() >> 56;
+        }
+
+    public:
+        std::uint64_t state;
+};
+
+} // namespace c8::rng
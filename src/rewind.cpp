@@ -0,0 +1,146 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "rewind.hpp"
+
+namespace c8::rwd {
+
+namespace {
+
+using Length = std::uint16_t;
+static_assert(sizeof(snap::State) <= UINT16_MAX);
+
+// Unchanged gaps shorter than a run header are cheaper to store with the run
+constexpr std::size_t min_gap = 2 * sizeof(Length);
+
+// Terminates a delta, alone it encodes a state identical to its keyframe
+constexpr Length end_marker = 0;
+
+void put(std::vector<std::uint8_t> &out, Length value) {
+    auto *bytes = reinterpret_cast<const std::uint8_t *>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(Length));
+}
+
+Length get(const std::uint8_t *&in) {
+    Length value;
+    std::memcpy(&value, in, sizeof(Length));
+    in += sizeof(Length);
+    return value;
+}
+
+} // namespace
+
+History::History(std::size_t capacity, std::size_t interval):
+    capacity(capacity ? capacity : 1), interval(interval ? interval : 1) { }
+
+void History::push(const snap::State &state) {
+    if (this->segments.empty() || (this->segments.back().offsets.size() + 1 >= this->interval)) {
+        auto &segment = this->segments.emplace_back();
+        segment.keyframe = state;
+    } else {
+        auto &segment = this->segments.back();
+        segment.offsets.push_back(segment.deltas.size());
+        encode(segment.keyframe, state, segment.deltas);
+    }
+    ++this->count;
+
+    while ((this->count > this->capacity) && (this->segments.size() > 1)) {
+        this->count -= this->segments.front().offsets.size() + 1;
+        this->segments.pop_front();
+    }
+}
+
+bool History::rewind(std::size_t frames, snap::State &state) {
+    if (this->segments.empty())
+        return false;
+
+    frames = std::min(frames, this->count - 1);
+    this->count -= frames;
+    while (frames) {
+        auto &segment = this->segments.back();
+        if (frames > segment.offsets.size()) {
+            frames -= segment.offsets.size() + 1;
+            this->segments.pop_back();
+        } else {
+            segment.deltas.resize(segment.offsets[segment.offsets.size() - frames]);
+            segment.offsets.resize(segment.offsets.size() - frames);
+            frames = 0;
+        }
+    }
+
+    auto &segment = this->segments.back();
+    if (segment.offsets.empty())
+        state = segment.keyframe;
+    else
+        decode(segment.keyframe, segment.deltas.data() + segment.offsets.back(), state);
+    return true;
+}
+
+std::size_t History::bytes() const noexcept {
+    std::size_t total = 0;
+    for (auto &segment: this->segments)
+        total += sizeof(Segment) + segment.deltas.capacity() + segment.offsets.capacity() * sizeof(std::uint32_t);
+    return total;
+}
+
+void History::encode(const snap::State &key, const snap::State &state, std::vector<std::uint8_t> &out) {
+    auto *a = reinterpret_cast<const std::uint8_t *>(&key);
+    auto *b = reinterpret_cast<const std::uint8_t *>(&state);
+
+    std::size_t pos = 0;
+    while (true) {
+        auto start = pos;
+        while ((pos < sizeof(snap::State)) && (a[pos] == b[pos]))
+            ++pos;
+        if (pos == sizeof(snap::State))
+            break;
+        auto skip = pos - start;
+
+        // Extend the run over changed bytes and over gaps too short to be worth a new run
+        auto run = pos, last = pos;
+        while ((pos < sizeof(snap::State)) && (pos - last <= min_gap)) {
+            if (a[pos] != b[pos])
+                last = pos;
+            ++pos;
+        }
+        pos = last + 1;
+
+        put(out, skip + 1); // Offset by one, 0 terminates the delta
+        put(out, pos - run);
+        for (auto i = run; i < pos; ++i)
+            out.push_back(a[i] ^ b[i]);
+    }
+    put(out, end_marker);
+}
+
+void History::decode(const snap::State &key, const std::uint8_t *delta, snap::State &state) {
+    state = key;
+    auto *out = reinterpret_cast<std::uint8_t *>(&state);
+
+    std::size_t pos = 0;
+    for (Length skip; (skip = get(delta)) != end_marker;) {
+        pos += skip - 1;
+        for (auto count = get(delta); count; --count)
+            out[pos++] ^= *delta++;
+    }
+}
+
+} // namespace c8::rwd
@@ -0,0 +1,67 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "snapshot.hpp"
+
+namespace c8::rwd {
+
+// Per-frame history of machine states. Every interval frames a full state is kept as keyframe,
+// the frames in between only store the bytes that differ from it, XORed against it:
+// runs of [skip][count][count bytes], so frames touching a few bytes cost a few bytes
+class History {
+    public:
+        // Keeps at most capacity frames, dropping the oldest keyframe interval first
+        History(std::size_t capacity, std::size_t interval = 120);
+
+        void push(const snap::State &state);
+
+        // Drops the latest frames, always keeping the oldest one,
+        // then decodes the new latest one into state. Fails when empty
+        bool rewind(std::size_t frames, snap::State &state);
+
+        inline std::size_t frames() const noexcept {
+            return this->count;
+        }
+
+        // Heap memory held by the history
+        std::size_t bytes() const noexcept;
+
+    protected:
+        struct Segment {
+            snap::State                keyframe;
+            std::vector<std::uint8_t>  deltas;
+            std::vector<std::uint32_t> offsets; // Start of each delta, the keyframe itself has none
+        };
+
+        static void encode(const snap::State &key, const snap::State &state, std::vector<std::uint8_t> &out);
+        static void decode(const snap::State &key, const std::uint8_t *delta, snap::State &state);
+
+    protected:
+        std::size_t         capacity, interval;
+        std::size_t         count = 0;
+        std::deque<Segment> segments;
+};
+
+} // namespace c8::rwd
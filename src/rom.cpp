@@ -0,0 +1,144 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.hpp"
+
+#include "rom.hpp"
+
+namespace c8::rom {
+
+namespace {
+
+// Device, inode, modification time (seconds, nanoseconds) and size
+using FileKey = std::tuple<dev_t, ino_t, std::int64_t, std::int64_t, off_t>;
+
+// Images stay shared for as long as a machine or caller holds them
+struct Cache {
+    std::mutex mtx;
+    std::unordered_multimap<std::uint64_t, std::weak_ptr<const Program>> images;
+    std::map<FileKey, std::weak_ptr<const Program>> files;
+    std::size_t prune_at = 16;
+};
+
+Cache &cache() {
+    static Cache cache;
+    return cache;
+}
+
+} // namespace
+
+Program::Program(std::vector<std::uint8_t> bytes): owned(std::move(bytes)) {
+    this->bytes  = this->owned.data();
+    this->length = this->owned.size();
+    this->digest = utils::fnv1a(this->bytes, this->length);
+}
+
+Program::Program(const std::uint8_t *mapping, std::size_t size): bytes(mapping), length(size), mapped(true) {
+    this->digest = utils::fnv1a(this->bytes, this->length);
+}
+
+Program::~Program() {
+    if (this->mapped)
+        munmap(const_cast<std::uint8_t *>(this->bytes), this->length);
+}
+
+std::shared_ptr<const Program> Program::map(int fd, std::size_t size) {
+    // The mapping outlives the descriptor
+    auto *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        return nullptr;
+    return std::shared_ptr<const Program>(new Program(static_cast<const std::uint8_t *>(mapping), size));
+}
+
+std::shared_ptr<const Program> load(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ERROR("Failed to open %s\n", path.c_str());
+        return nullptr;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size <= 0)) {
+        ERROR("Failed to stat %s or it is empty\n", path.c_str());
+        close(fd);
+        return nullptr;
+    }
+
+    auto &[mtx, images, files, prune_at] = cache();
+    auto key = FileKey(st.st_dev, st.st_ino, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_size);
+    {
+        std::scoped_lock lk(mtx);
+        if (auto it = files.find(key); it != files.end()) {
+            if (auto image = it->second.lock(); image) {
+                close(fd);
+                return image;
+            }
+        }
+    }
+
+    auto program = Program::map(fd, st.st_size);
+    close(fd);
+    if (!program) {
+        ERROR("Failed to map %s\n", path.c_str());
+        return nullptr;
+    }
+    TRACE("Mapped %s\n", path.c_str());
+
+    std::scoped_lock lk(mtx);
+
+    // Drop the entries nobody holds once the file map doubles, so sweeping costs O(1) per insert
+    if (files.size() >= prune_at) {
+        for (auto it = images.begin(); it != images.end();)
+            it = it->second.expired() ? images.erase(it) : std::next(it);
+        for (auto it = files.begin(); it != files.end();)
+            it = it->second.expired() ? files.erase(it) : std::next(it);
+        prune_at = std::max<std::size_t>(16, 2 * files.size());
+    }
+
+    // Hashes can collide, compare the bytes too
+    auto [it, end] = images.equal_range(program->hash());
+    while (it != end) {
+        auto image = it->second.lock();
+        if (!image) {
+            it = images.erase(it);
+            continue;
+        }
+        if ((image->size() == program->size()) && !std::memcmp(image->data(), program->data(), image->size())) {
+            files[key] = image;
+            return image;
+        }
+        ++it;
+    }
+
+    images.emplace(program->hash(), program);
+    files[key] = program;
+    return program;
+}
+
+} // namespace c8::rom
@@ -17,32 +17,73 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include "utils.hpp"
-
 namespace c8::rom {
 
-using Program = std::vector<std::uint16_t>;
+// Immutable program bytes, mapped read-only when they come from a file
+class Program {
+    public:
+        Program(std::vector<std::uint8_t> bytes);
+        Program(const Program &) = delete;
+        Program &operator =(const Program &) = delete;
+        ~Program();
+
+        // Maps size bytes of the open file fd, nullptr on failure. The mapping is not a snapshot:
+        // the file must not change while mapped, or the bytes and hash change under every holder
+        static std::shared_ptr<const Program> map(int fd, std::size_t size);
+
+        inline const std::uint8_t *data() const noexcept {
+            return this->bytes;
+        }
+
+        inline std::size_t size() const noexcept {
+            return this->length;
+        }
+
+        inline bool empty() const noexcept {
+            return !this->length;
+        }
+
+        inline std::uint64_t hash() const noexcept {
+            return this->digest;
+        }
+
+    protected:
+        Program(const std::uint8_t *mapping, std::size_t size);
+
+    protected:
+        const std::uint8_t        *bytes  = nullptr;
+        std::size_t                length = 0;
+        std::uint64_t              digest = 0;
+        bool                       mapped = false;
+        std::vector<std::uint8_t>  owned;
+};
+
+// Goes through a process-wide cache keyed on content, so every machine running the same
+// program shares one image whatever path it was loaded from. Files already loaded are found by
+// device, inode, modification time and size without being read again. nullptr if the file
+// can't be read
+std::shared_ptr<const Program> load(const std::string &path);
 
 class Rom {
     public:
-        Rom(const std::string &path) {
-            c8::utils::read_file(*this->rom, path);
-        }
+        Rom(const std::string &path): rom(rom::load(path)) { }
 
-        std::shared_ptr<Program> get_code() noexcept {
+        std::shared_ptr<const Program> get_code() noexcept {
             return this->rom;
         }
 
         inline bool empty() {
-            return this->rom->empty();
+            return !this->rom || this->rom->empty();
         }
 
     protected:
-        std::shared_ptr<Program> rom = std::make_shared<Program>();
+        std::shared_ptr<const Program> rom;
 };
 
 } // namespace c8::rom
@@ -0,0 +1,52 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <thread>
+
+#ifdef __MINGW32__
+#   include <synchapi.h>
+#endif
+
+#include "scheduler.hpp"
+
+namespace c8::sched {
+
+void Scheduler::pace() {
+    if (!this->realtime)
+        return;
+
+    auto now      = std::chrono::steady_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(frame_duration / this->speed);
+
+    // Resynchronize after a stall (pause, slow terminal, fast-forward) instead of running flat out to catch up
+    if ((this->deadline == decltype(this->deadline){}) || (now - this->deadline > 4 * duration))
+        this->deadline = now;
+
+    this->deadline += duration;
+    if (this->deadline <= now)
+        return;
+
+#ifdef __MINGW32__
+    // For some reason std::this_thread::sleep_for on windows is unreliable
+    Sleep(std::chrono::duration_cast<std::chrono::milliseconds>(this->deadline - now).count());
+#else
+    std::this_thread::sleep_until(this->deadline);
+#endif
+}
+
+} // namespace c8::sched
@@ -0,0 +1,87 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+namespace c8::sched {
+
+using namespace std::chrono_literals;
+
+constexpr inline std::uint32_t frame_rate     = 60;
+constexpr inline auto          frame_duration = std::chrono::nanoseconds(1s) / frame_rate;
+
+// Default CPU speed, 600 Hz
+constexpr inline std::uint32_t default_ipf    = 10;
+
+// Emulated time, measured in retired instructions. Timers tick every ipf instructions,
+// so runs are reproducible regardless of host speed
+class Scheduler {
+    public:
+        Scheduler(std::uint32_t ipf = default_ipf, bool realtime = false):
+            ipf(ipf ? ipf : 1), realtime(realtime), next_frame(this->ipf) { }
+
+        // Instructions left until the next frame boundary
+        inline std::uint64_t remaining() const noexcept {
+            return this->next_frame - this->cycles;
+        }
+
+        // Accounts for retired instructions, returns whether a frame boundary was reached
+        inline bool advance(std::uint64_t retired) noexcept {
+            this->cycles += retired;
+            if (this->cycles < this->next_frame)
+                return false;
+            this->next_frame += this->ipf;
+            ++this->frames;
+            return true;
+        }
+
+        // Sleeps until real time catches up with one more frame, no-op unless realtime
+        void pace();
+
+        // Emulated frames per real frame, scales the CPU speed and the timer rate together
+        inline void set_speed(double speed) noexcept {
+            this->speed = (speed > 0) ? speed : 1;
+        }
+
+        // Resumes emulated time from a snapshot
+        inline void restore(std::uint64_t cycles, std::uint64_t frames, std::uint64_t remaining) noexcept {
+            this->cycles     = cycles;
+            this->frames     = frames;
+            this->next_frame = cycles + remaining;
+        }
+
+        inline std::uint32_t get_ipf() const noexcept {
+            return this->ipf;
+        }
+
+    public:
+        std::uint64_t cycles = 0, frames = 0;
+
+    protected:
+        std::uint32_t ipf;
+        bool          realtime;
+        double        speed = 1;
+        std::uint64_t next_frame;
+
+        std::chrono::steady_clock::time_point deadline{};
+};
+
+} // namespace c8::sched
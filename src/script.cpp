@@ -0,0 +1,117 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "chip8.hpp"
+#include "utils.hpp"
+
+#include "script.hpp"
+
+namespace c8::script {
+
+bool load(const std::string &path, Movie &movie) {
+    movie = {};
+    auto &script = movie.script;
+
+    auto *fp = utils::open_file(path, "r");
+    if (!fp)
+        return false;
+
+    char line[256];
+    for (std::size_t nr = 1; std::fgets(line, sizeof(line), fp); ++nr) {
+        if (auto *comment = std::strchr(line, '#'); comment)
+            *comment = 0;
+
+        char name[16], extra;
+        std::uint64_t cycle, value;
+        unsigned int key;
+        if (std::sscanf(line, "%15s %" SCNu64 " %c", name, &value, &extra) == 2) {
+            if (!std::strcmp(name, "seed")) {
+                movie.seed = value;
+                continue;
+            } else if (!std::strcmp(name, "ipf")) {
+                movie.ipf = value;
+                continue;
+            } else if (!std::strcmp(name, "length")) {
+                movie.length = value;
+                continue;
+            }
+        }
+
+        switch (std::sscanf(line, "%" SCNu64 " %x %c", &cycle, &key, &extra)) {
+            case EOF:
+                continue;
+            case 2:
+                if (win::Window::is_key_in_range(static_cast<win::Key>(key))) {
+                    script.push_back({ cycle, static_cast<win::Key>(key) });
+                    continue;
+                }
+                [[fallthrough]];
+            default:
+                ERROR("%s:%zu: expected \"cycle key\"\n", path.c_str(), nr);
+                std::fclose(fp);
+                return false;
+        }
+    }
+
+    std::fclose(fp);
+    std::stable_sort(script.begin(), script.end(), [](auto &lhs, auto &rhs) { return lhs.cycle < rhs.cycle; });
+    return true;
+}
+
+bool save(const std::string &path, const Movie &movie) {
+    auto *fp = utils::open_file(path, "w");
+    if (!fp)
+        return false;
+
+    std::fprintf(fp, "seed %" PRIu64 "\nipf %" PRIu32 "\nlength %" PRIu64 "\n", movie.seed, movie.ipf, movie.length);
+    for (auto &event: movie.script)
+        std::fprintf(fp, "%" PRIu64 " %x\n", event.cycle, event.key);
+
+    bool ok = !std::ferror(fp);
+    ok &= !std::fclose(fp);
+    if (!ok)
+        ERROR("Failed to write %s\n", path.c_str());
+    return ok;
+}
+
+std::uint64_t Player::feed(Chip8 &chip) {
+    for (; (this->next != this->script.end()) && (this->next->cycle <= chip.scheduler.cycles); ++this->next)
+        chip.window->press(this->next->key);
+    return (this->next != this->script.end()) ? this->next->cycle - chip.scheduler.cycles : UINT64_MAX;
+}
+
+std::uint64_t run(Chip8 &chip, const Script &script, std::uint64_t budget) {
+    std::uint64_t executed = 0;
+    Player player(script);
+    while (executed < budget) {
+        // Stop exactly at the next event so it is delivered at the same instruction in every mode
+        auto limit = std::min(budget - executed, player.feed(chip));
+        auto retired = chip.run_frame(limit);
+        if (!retired)
+            break;
+        executed += retired;
+    }
+    return executed;
+}
+
+} // namespace c8::script
@@ -0,0 +1,74 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "window.hpp"
+
+namespace c8 {
+
+class Chip8;
+
+} // namespace c8
+
+namespace c8::script {
+
+// Key pressed once the machine has retired cycle instructions
+struct Event {
+    std::uint64_t cycle;
+    win::Key      key;
+};
+
+// Sorted by cycle
+using Script = std::vector<Event>;
+
+// Everything a run depends on besides the rom, enough to reproduce it exactly
+struct Movie {
+    std::uint64_t seed   = 0; // Of the random number generator
+    std::uint32_t ipf    = 0; // 0 when not recorded
+    std::uint64_t length = 0; // Instructions recorded, 0 when not recorded
+    Script        script;
+};
+
+// One "cycle key" pair per line, key in hex, '#' starts a comment.
+// "seed n", "ipf n" and "length n" lines fill in the rest of the movie
+bool load(const std::string &path, Movie &movie);
+bool save(const std::string &path, const Movie &movie);
+
+// Delivers the events of a script as the machine reaches their cycle
+class Player {
+    public:
+        Player(const Script &script): script(script), next(script.begin()) { }
+
+        // Presses the keys due by now, returns the instructions left until the next event
+        std::uint64_t feed(Chip8 &chip);
+
+    protected:
+        const Script           &script;
+        Script::const_iterator  next;
+};
+
+// Runs a headless machine for budget instructions while feeding it the script,
+// returns the number of instructions retired
+std::uint64_t run(Chip8 &chip, const Script &script, std::uint64_t budget);
+
+} // namespace c8::script
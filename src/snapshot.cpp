@@ -0,0 +1,57 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cstdio>
+
+#include "utils.hpp"
+
+#include "snapshot.hpp"
+
+namespace c8::snap {
+
+bool write(const std::string &path, const State &state) {
+    auto *fp = utils::open_file(path, "wb");
+    if (!fp)
+        return false;
+
+    bool ok = std::fwrite(&state, sizeof(State), 1, fp) == 1;
+    ok &= !std::fclose(fp);
+    if (!ok)
+        ERROR("Failed to write %s\n", path.c_str());
+    return ok;
+}
+
+bool read(const std::string &path, State &state) {
+    auto *fp = utils::open_file(path, "rb");
+    if (!fp)
+        return false;
+
+    State tmp;
+    bool ok = std::fread(&tmp, sizeof(State), 1, fp) == 1;
+    std::fclose(fp);
+
+    if (!ok || (tmp.header.magic != magic) || (tmp.header.version != version) || (tmp.header.size != sizeof(State))) {
+        ERROR("%s is not a compatible snapshot\n", path.c_str());
+        return false;
+    }
+
+    state = tmp;
+    return true;
+}
+
+} // namespace c8::snap
@@ -0,0 +1,61 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <type_traits>
+
+#include "chip8.hpp"
+#include "window.hpp"
+
+namespace c8::snap {
+
+constexpr inline std::array<char, 4> magic   = { 'C', '8', 'S', 'S' };
+constexpr inline std::uint32_t       version = 2;
+
+struct Header {
+    std::array<char, 4> magic    = snap::magic;
+    std::uint32_t       version  = snap::version;
+    std::uint32_t       size     = 0; // Of the whole state, header included
+    std::uint32_t       reserved = 0;
+};
+
+// Complete machine state, written out as is in host byte order.
+// Bump the version whenever the layout changes
+struct State {
+    Header        header;
+    Registers     regs;
+    Stack         stack;
+    Ram           ram;
+    win::Buffer   buf;
+    win::Keys     keys;          // Pending key presses
+    std::uint64_t cycles, frames;
+    std::uint64_t remaining;     // Instructions until the next timer tick
+    std::uint64_t rng;           // Generator state
+};
+static_assert(std::is_trivially_copyable_v<State>);
+
+bool write(const std::string &path, const State &state);
+
+// Fails on anything not written by the same version
+bool read(const std::string &path, State &state);
+
+} // namespace c8::snap
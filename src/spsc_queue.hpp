@@ -0,0 +1,63 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+namespace c8 {
+
+// Bounded lock-free queue between exactly one producer and one consumer thread
+template <typename T, std::size_t N>
+class SpscQueue {
+    static_assert(N && !(N & (N - 1)), "Capacity must be a power of two");
+
+    public:
+        // Returns false when full
+        inline bool push(const T &value) noexcept {
+            auto tail = this->tail.load(std::memory_order_relaxed);
+            if (tail - this->head.load(std::memory_order_acquire) == N)
+                return false;
+            this->slots[tail % N] = value;
+            this->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Returns false when empty
+        inline bool pop(T &value) noexcept {
+            auto head = this->head.load(std::memory_order_relaxed);
+            if (head == this->tail.load(std::memory_order_acquire))
+                return false;
+            value = this->slots[head % N];
+            this->head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        inline bool empty() const noexcept {
+            return this->head.load(std::memory_order_acquire) == this->tail.load(std::memory_order_acquire);
+        }
+
+    protected:
+        std::array<T, N> slots{};
+        alignas(64) std::atomic<std::size_t> head = 0;
+        alignas(64) std::atomic<std::size_t> tail = 0;
+};
+
+} // namespace c8
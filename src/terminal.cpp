@@ -0,0 +1,215 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+
+#include "scheduler.hpp"
+#include "utils.hpp"
+
+#include "terminal.hpp"
+
+using namespace std::chrono_literals;
+
+namespace c8::win {
+
+Terminal::Terminal(): win(initscr()),
+        pause_win(newwin(pause_win_height, pause_win_width, pause_win_y, pause_win_x)) {
+    wresize(this->win, window_height, window_width);
+    cbreak();
+    noecho();
+    nodelay(stdscr, true);
+    curs_set(0); // Hide cursor
+
+    box(this->win, 0, 0);
+    wrefresh(this->win);
+
+    this->render_thread = std::thread(&Terminal::render, this);
+
+    if (pipe(this->wake_pipe) == 0)
+        this->input_thread = std::thread(&Terminal::input, this);
+    else
+        ERROR("Failed to create pipe, input is disabled\n");
+}
+
+Terminal::~Terminal() {
+    {
+        // Under the lock so the render thread cannot miss it between its check and its wait
+        std::lock_guard lk(this->wake_mtx);
+        this->render_thread_should_stop = true;
+    }
+    this->wake_cv.notify_one();
+    this->render_thread.join();
+
+    if (this->input_thread.joinable()) {
+        char c = 0;
+        UNUSED(!write(this->wake_pipe[1], &c, sizeof(c)));
+        this->input_thread.join();
+        close(this->wake_pipe[0]);
+        close(this->wake_pipe[1]);
+    }
+
+    nocbreak();
+    echo();
+    delwin(this->win);
+    endwin();
+}
+
+void Terminal::update() {
+    int chr;
+    while (this->events.pop(chr)) {
+        this->press(chr_to_key(chr));
+        if (chr == ' ')
+            this->should_pause ^= 1;
+        if (chr == '\t')
+            this->should_fast_forward ^= 1;
+        if (chr == 'o')
+            this->should_save = true;
+        if (chr == 'p')
+            this->should_load = true;
+        if (chr == 'u')
+            this->should_rewind = true;
+    }
+
+    if (!this->dirty && (this->should_pause == this->published_paused))
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if ((this->should_pause == this->published_paused) && (now - this->last_publish < sched::frame_duration))
+        return;
+    this->last_publish = now;
+
+    auto &frame = this->frames.back();
+    frame.buf    = this->buf;
+    frame.paused = this->published_paused = this->should_pause;
+    {
+        // Same as in the destructor, a frame published outside the lock could sit out the timeout
+        std::lock_guard lk(this->wake_mtx);
+        this->frames.publish();
+    }
+    this->dirty = 0;
+
+    this->wake_cv.notify_one();
+}
+
+void Terminal::render() {
+    while (!this->render_thread_should_stop) {
+        {
+            std::unique_lock lk(this->wake_mtx);
+            this->wake_cv.wait_for(lk, 100ms, [this] {
+                return this->frames.has_fresh() || this->render_thread_should_stop;
+            });
+        }
+
+        if (!this->frames.fetch())
+            continue;
+
+        std::lock_guard lk(this->curses_mtx);
+        this->draw(this->frames.front());
+    }
+}
+
+void Terminal::draw(const Frame &frame) {
+    if (frame.paused) {
+        this->was_paused = true;
+        this->draw_pause();
+        return;
+    }
+
+    // Bring back what the pause overlay covered
+    if (this->was_paused) {
+        touchwin(this->win);
+        this->was_paused = false;
+    }
+
+    // Only touch the cells that changed since the last frame
+    for (std::uint8_t y = 0; y < height; ++y) {
+        for (auto changed = frame.buf[y] ^ this->shown[y]; changed; changed &= changed - 1) {
+            auto bit = __builtin_ctzll(changed);
+            auto px  = (frame.buf[y] >> bit) & 1;
+            if (px)
+                wattron(this->win, A_REVERSE);
+            mvwaddstr(this->win, y + 1, 2 * (width - 1 - bit) + 1, "  ");
+            if (px)
+                wattroff(this->win, A_REVERSE);
+        }
+        this->shown[y] = frame.buf[y];
+    }
+    wrefresh(this->win);
+}
+
+void Terminal::draw_pause() {
+    box(this->pause_win, 0, 0);
+    attron(A_BOLD);
+    mvwprintw(this->pause_win, 2, 4, "PAUSED");
+    attroff(A_BOLD);
+    wrefresh(this->pause_win);
+}
+
+void Terminal::input() {
+    std::array<pollfd, 2> fds = {{
+        { STDIN_FILENO,        POLLIN, 0 },
+        { this->wake_pipe[0],  POLLIN, 0 },
+    }};
+
+    // Read but not queued yet because the emulation was not keeping up, retried every frame
+    int pending = ERR;
+    auto retry = std::chrono::duration_cast<std::chrono::milliseconds>(sched::frame_duration).count() + 1;
+
+    while (true) {
+        // While a character is pending, stdin stays readable, only wait for the wake pipe
+        fds[0].revents = 0;
+        auto ret = (pending == ERR) ? poll(fds.data(), fds.size(), -1) : poll(&fds[1], 1, retry);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        bool read = false, full = false;
+        {
+            std::lock_guard lk(this->curses_mtx);
+            while (true) {
+                if ((pending == ERR) && ((pending = getch()) == ERR))
+                    break;
+                read = true;
+                if (!this->events.push(pending)) {
+                    full = true;
+                    break;
+                }
+                pending = ERR;
+            }
+        }
+
+        if (read || full || (fds[0].fd < 0))
+            continue;
+
+        // Hung up, or readable yet empty like a file at its end: nothing more will come,
+        // only the wake pipe is left to watch
+        if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL))
+            break;
+        if (fds[0].revents & POLLIN)
+            fds[0].fd = -1;
+    }
+}
+
+} // namespace c8::win
@@ -0,0 +1,87 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <curses.h>
+
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+#include "window.hpp"
+
+namespace c8::win {
+
+constexpr static std::uint8_t window_width  = width * 2 + 2;
+constexpr static std::uint8_t window_height = height + 2;
+
+constexpr static std::uint8_t pause_win_height = 5;
+constexpr static std::uint8_t pause_win_width  = 14;
+constexpr static std::uint8_t pause_win_x      = (window_width  + 2 - pause_win_width)  / 2;
+constexpr static std::uint8_t pause_win_y      = (window_height + 2 - pause_win_height) / 2;
+
+// ncurses frontend. Frames are drawn and input is read by separate threads,
+// so the emulation never waits on the terminal
+class Terminal: public Window {
+    public:
+        Terminal();
+        ~Terminal();
+
+        // Consumes input events and hands the framebuffer over to the render thread
+        void update() override;
+
+    private:
+        struct Frame {
+            Buffer buf;
+            bool   paused;
+        };
+
+        void render();
+        void draw(const Frame &frame);
+        void draw_pause();
+
+        void input();
+
+    private:
+        WINDOW *win, *pause_win;
+
+        TripleBuffer<Frame> frames;
+        bool                published_paused = false;
+
+        // Frames are skipped when the machine runs faster than the display
+        std::chrono::steady_clock::time_point last_publish{};
+
+        std::mutex              curses_mtx;  // ncurses is not thread-safe
+        std::mutex              wake_mtx;
+        std::condition_variable wake_cv;
+        std::atomic_bool        render_thread_should_stop = false;
+        std::thread             render_thread;
+
+        SpscQueue<int, 64> events;         // Characters read by the input thread
+        int                wake_pipe[2];   // Unblocks the input thread on exit
+        std::thread        input_thread;
+
+        // Render thread state
+        Buffer shown{}; // Framebuffer as currently drawn
+        bool   was_paused = false;
+};
+
+} // namespace c8::win
@@ -0,0 +1,113 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "utils.hpp"
+
+#include "trace.hpp"
+
+namespace c8::trace {
+
+std::unique_ptr<Writer> Writer::open(const std::string &path, std::uint64_t start_cycle) {
+    auto *fp = utils::open_file(path, "wb");
+    if (!fp)
+        return nullptr;
+
+    Header header;
+    header.record_size = sizeof(Record);
+    header.start_cycle = start_cycle;
+    if (std::fwrite(&header, sizeof(header), 1, fp) != 1) {
+        std::fclose(fp);
+        return nullptr;
+    }
+    return std::make_unique<Writer>(fp);
+}
+
+Writer::Writer(std::FILE *fp): fp(fp) {
+    for (std::size_t i = 0; i < chunk_count; ++i) {
+        this->chunks[i].resize(chunk_size);
+        if (i)
+            this->spare.push(i);
+    }
+    this->current = this->chunks[0].data();
+    this->thread  = std::thread(&Writer::write, this);
+}
+
+Writer::~Writer() {
+    this->finish();
+}
+
+bool Writer::finish() {
+    if (!this->fp)
+        return !this->failed;
+
+    // Hand over the partial chunk, then let the thread drain everything
+    if (this->used) {
+        this->chunks[this->index].resize(this->used);
+        this->full.push(this->index);
+    }
+    {
+        std::lock_guard lk(this->mtx);
+        this->should_stop = true;
+    }
+    this->cv.notify_all();
+    this->thread.join();
+
+    if (std::fclose(this->fp))
+        this->failed = true;
+    this->fp = nullptr;
+    return !this->failed;
+}
+
+void Writer::submit() {
+    {
+        std::unique_lock lk(this->mtx);
+        this->full.push(this->index);
+        this->cv.notify_all();
+        this->cv.wait(lk, [this] { return !this->spare.empty(); });
+    }
+
+    this->spare.pop(this->index);
+    this->current = this->chunks[this->index].data();
+    this->used    = 0;
+}
+
+void Writer::write() {
+    while (true) {
+        std::size_t chunk;
+        {
+            std::unique_lock lk(this->mtx);
+            this->cv.wait(lk, [this] { return !this->full.empty() || this->should_stop; });
+            if (!this->full.pop(chunk))
+                return; // Stopping with nothing left
+        }
+
+        auto &records = this->chunks[chunk];
+        if (std::fwrite(records.data(), sizeof(Record), records.size(), this->fp) != records.size()) {
+            ERROR("Failed to write trace\n");
+            this->failed = true;
+        }
+
+        {
+            std::lock_guard lk(this->mtx);
+            this->spare.push(chunk);
+        }
+        this->cv.notify_all();
+    }
+}
+
+} // namespace c8::trace
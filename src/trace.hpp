@@ -0,0 +1,131 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "instruction.hpp"
+#include "spsc_queue.hpp"
+#include "utils.hpp"
+
+namespace c8::trace {
+
+constexpr inline std::array<char, 4> magic   = { 'C', '8', 'T', 'R' };
+constexpr inline std::uint32_t       version = 2;
+
+struct Header {
+    std::array<char, 4> magic       = trace::magic;
+    std::uint32_t       version     = trace::version;
+    std::uint32_t       record_size = 0;
+    std::uint32_t       reserved    = 0;
+    std::uint64_t       start_cycle = 0;
+};
+
+// One executed instruction, state after it ran. Written in host byte order
+struct Record {
+    std::uint32_t cycle;   // Low bits of the instruction count it started at
+    std::uint16_t pc;
+    std::uint16_t op;
+    std::uint16_t i;
+    std::uint16_t addr;    // I before the instruction ran, where Fx33/Fx55/Fx65 start
+    std::uint8_t  vx, vf;  // The registers an instruction can change, Fx65 loads the others
+    std::uint8_t  written; // Bytes stored to memory
+    std::uint8_t  dt;
+};
+ASSERT_SIZE(Record, 16);
+
+// Follows the record of an instruction moving bytes between memory and registers: the bytes
+// Fx33/Fx55 stored or Fx65 loaded, from addr on. Together they replay memory and V0-Vf
+struct Payload {
+    std::array<std::uint8_t, 16> bytes;
+};
+ASSERT_SIZE(Payload, sizeof(Record));
+
+// Bytes an instruction of this kind stores, starting at I
+constexpr inline std::uint8_t written(ins::Kind kind, ins::Opcode op) noexcept {
+    switch (kind) {
+        case ins::Kind::LdBcd:   return 3;
+        case ins::Kind::LdStore: return op.x() + 1;
+        default:                 return 0;
+    }
+}
+
+// Bytes an instruction of this kind moves, a payload follows its record when not 0
+constexpr inline std::uint8_t moved(ins::Kind kind, ins::Opcode op) noexcept {
+    return (kind == ins::Kind::LdLoad) ? op.x() + 1 : written(kind, op);
+}
+
+// Fills chunks of records and hands them over to a thread writing them out,
+// the emulation only waits when the disk falls behind by every spare chunk
+class Writer {
+    public:
+        // Null if the file couldn't be created
+        static std::unique_ptr<Writer> open(const std::string &path, std::uint64_t start_cycle);
+
+        Writer(std::FILE *fp);
+        ~Writer();
+
+        inline void push(const Record &record) {
+            this->current[this->used] = record;
+            if (++this->used == chunk_size)
+                this->submit();
+        }
+
+        inline void push(const Payload &payload) {
+            std::memcpy(&this->current[this->used], &payload, sizeof(payload));
+            if (++this->used == chunk_size)
+                this->submit();
+        }
+
+        // Writes out every record pushed and closes the file, returns whether it is complete.
+        // The destructor does the same when not called before
+        bool finish();
+
+        constexpr static std::size_t chunk_size  = 0x10000; // Records, 1 MiB
+        constexpr static std::size_t chunk_count = 4;
+
+    protected:
+        void submit();
+        void write();
+
+    protected:
+        std::FILE                                      *fp;
+        std::array<std::vector<Record>, chunk_count>    chunks;
+        Record                                         *current;
+        std::size_t                                     used = 0, index = 0;
+
+        SpscQueue<std::size_t, chunk_count * 2>         full, spare;
+        std::mutex                                      mtx;
+        std::condition_variable                         cv;
+        std::atomic_bool                                should_stop = false, failed = false;
+        std::thread                                     thread;
+};
+
+} // namespace c8::trace
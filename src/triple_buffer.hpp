@@ -0,0 +1,65 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+
+namespace c8 {
+
+// Single producer, single consumer handoff of the latest value. Neither side ever waits:
+// the producer fills back() then publishes it, the consumer picks up the most recent
+// publication if there is one, intermediate ones are dropped
+template <typename T>
+class TripleBuffer {
+    public:
+        inline T &back() noexcept {
+            return this->slots[this->back_idx];
+        }
+
+        inline void publish() noexcept {
+            this->back_idx = this->middle.exchange(this->back_idx | fresh_bit, std::memory_order_acq_rel) & index_mask;
+        }
+
+        inline bool has_fresh() const noexcept {
+            return this->middle.load(std::memory_order_relaxed) & fresh_bit;
+        }
+
+        // Returns whether front() changed
+        inline bool fetch() noexcept {
+            if (!this->has_fresh())
+                return false;
+            this->front_idx = this->middle.exchange(this->front_idx, std::memory_order_acq_rel) & index_mask;
+            return true;
+        }
+
+        inline const T &front() const noexcept {
+            return this->slots[this->front_idx];
+        }
+
+    protected:
+        constexpr static std::uint8_t fresh_bit = 1 << 2, index_mask = fresh_bit - 1;
+
+        std::array<T, 3>          slots{};
+        std::uint8_t              back_idx = 0, front_idx = 2;
+        std::atomic<std::uint8_t> middle = 1;
+};
+
+} // namespace c8
@@ -17,9 +17,10 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <string>
-#include <vector>
 
 #define _STRINGIFY(x)      #x
 #define _CONCATENATE(x, y) x##y
@@ -43,6 +44,15 @@
 
 namespace c8::utils {
 
+// 64-bit FNV-1a, chain calls by passing the previous result as seed
+static inline std::uint64_t fnv1a(const void *data, std::size_t size,
+        std::uint64_t seed = 0xcbf29ce484222325) noexcept {
+    auto *bytes = static_cast<const std::uint8_t *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+        seed = (seed ^ bytes[i]) * 0x100000001b3;
+    return seed;
+}
+
 static inline FILE *open_file(const std::string &path, const std::string &mode = "rb") {
     FILE *fp = fopen(path.c_str(), mode.c_str());
     if (!fp)
@@ -52,24 +62,4 @@ static inline FILE *open_file(const std::string &path, const std::string &mode =
     return fp;
 }
 
-template <typename T>
-static inline std::vector<T> &read_file(std::vector<T> &container, const std::string &path) {
-    container.clear();
-
-    FILE *fp = open_file(path);
-    if (!fp)
-        return container;
-
-    fseek(fp, 0, SEEK_END);
-    std::size_t size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    container.resize(size / sizeof(T) + 1);
-    if (fread(container.data(), 1, size, fp) != size)
-        ERROR("Failed to read %s\n", path.c_str());
-    container[size] = static_cast<T>(0); // Ensure null termination
-
-    return container;
-}
-
 } // namespace c8::utils
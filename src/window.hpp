@@ -17,28 +17,22 @@
 
 #pragma once
 
+#include <climits>
+#include <cstddef>
 #include <cstdint>
 #include <array>
-#include <vector>
-#include <thread>
-#include <atomic>
-#include <chrono>
-#include <curses.h>
 
 namespace c8::win {
 
 constexpr static std::uint8_t width         = 64;
 constexpr static std::uint8_t height        = 32;
-constexpr static std::uint8_t window_width  = width * 2 + 2;
-constexpr static std::uint8_t window_height = height + 2;
 
-constexpr static std::uint8_t pause_win_height = 5;
-constexpr static std::uint8_t pause_win_width  = 14;
-constexpr static std::uint8_t pause_win_x      = (window_width  + 2 - pause_win_width)  / 2;
-constexpr static std::uint8_t pause_win_y      = (window_height + 2 - pause_win_height) / 2;
+// One word per row, the leftmost pixel in the most significant bit
+using Row    = std::uint64_t;
+using Buffer = std::array<Row, height>;
+static_assert(sizeof(Row) * CHAR_BIT == width);
 
-using Buffer = std::array<std::uint8_t, width * height>;
-using Sprite = std::vector<std::uint8_t>;
+constexpr static std::uint8_t max_sprite_height = 15;
 
 enum Key: int {
     Key1       = 1,
@@ -60,17 +54,25 @@ enum Key: int {
     KeyInvalid = 0x10,
 };
 
+// Pending presses of each key
+using Keys = std::array<std::uint16_t, KeyInvalid>;
+
+// Display and input state shared by every frontend
 class Window {
     public:
-        Window();
-        ~Window();
-
-        void update();
+        virtual ~Window() = default;
 
-        void draw_pause();
+        // Polls input and presents the framebuffer, called once per frame and while paused
+        virtual void update() { }
 
         void clear();
-        bool apply_sprite(const Sprite &sprite, std::uint8_t x, std::uint8_t y);
+
+        // XORs rows of 8 pixels at (x, y), wrapping around the edges, returns whether any pixel was erased
+        bool apply_sprite(const std::uint8_t *sprite, std::size_t rows, std::uint8_t x, std::uint8_t y);
+
+        inline bool pixel(std::uint8_t x, std::uint8_t y) const {
+            return (this->buf[y] >> (width - 1 - x)) & 1;
+        }
 
         static constexpr inline Key chr_to_key(int chr) {
             switch(chr) {
@@ -98,19 +100,41 @@ class Window {
             return key < KeyInvalid;
         }
 
-        Key wait_for_key();
+        // Queues a key press, consumed by the next check of that key
+        inline void press(Key key) {
+            if (is_key_in_range(key))
+                ++this->keys[key];
+        }
+
+        // Consumes any pending key press, KeyInvalid if there is none
+        Key pop_key();
         bool is_key_down(Key key);
         bool is_key_up(Key key);
 
+        inline const Keys &get_keys() const {
+            return this->keys;
+        }
+
+        inline void set_keys(const Keys &keys) {
+            this->keys = keys;
+        }
+
     public:
         Buffer buf{};
 
-        bool should_pause = false;
+        // Rows modified since the last presentation, one bit per row
+        std::uint32_t dirty = 0;
 
-    private:
-        std::array<std::uint16_t, KeyInvalid> keys{};
+        bool should_pause = false;
+        bool should_fast_forward = false; // Run unthrottled
+        bool should_save = false, should_load = false; // Snapshot requests, cleared once handled
+        bool should_rewind = false;
 
-        WINDOW *win, *pause_win;
+    protected:
+        Keys keys{};
 };
 
+// No output, input only comes from press()
+class Headless: public Window { };
+
 } // namespace c8::win
@@ -0,0 +1,177 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "chip8.hpp"
+#include "pool.hpp"
+#include "rom.hpp"
+#include "script.hpp"
+#include "utils.hpp"
+
+namespace {
+
+struct Job {
+    std::string   rom, script;
+    std::uint64_t budget;
+
+    // Shared by every job running the same bytes
+    std::shared_ptr<const c8::rom::Program> program;
+
+    // Results
+    bool          ok = false;
+    std::uint64_t hash = 0, executed = 0;
+    double        seconds = 0;
+};
+
+// One "rom script budget" triple per line, "-" for no script, '#' starts a comment
+bool load_manifest(const char *path, std::vector<Job> &jobs) {
+    auto *fp = c8::utils::open_file(path, "r");
+    if (!fp)
+        return false;
+
+    char line[1024], rom[512], script[512];
+    for (std::size_t nr = 1; std::fgets(line, sizeof(line), fp); ++nr) {
+        if (auto *comment = std::strchr(line, '#'); comment)
+            *comment = 0;
+
+        std::uint64_t budget;
+        char extra;
+        switch (std::sscanf(line, "%511s %511s %" SCNu64 " %c", rom, script, &budget, &extra)) {
+            case EOF:
+                continue;
+            case 3:
+                jobs.push_back({ rom, script, budget, c8::rom::load(rom) });
+                continue;
+            default:
+                std::fprintf(stderr, "%s:%zu: expected \"rom script budget\"\n", path, nr);
+                std::fclose(fp);
+                return false;
+        }
+    }
+
+    std::fclose(fp);
+    return true;
+}
+
+void run(Job &job, c8::Chip8::Mode mode, std::uint32_t ipf) {
+    c8::script::Movie movie;
+    if (!job.program || ((job.script != "-") && !c8::script::load(job.script, movie)))
+        return;
+
+    // Recorded movies carry their own speed, plain scripts replay with seed 0
+    auto start = std::chrono::steady_clock::now();
+    auto chip  = c8::Chip8(job.program, mode, true, movie.ipf ? movie.ipf : ipf);
+    chip.seed(movie.seed);
+    job.executed = c8::script::run(chip, movie.script, job.budget ? job.budget : movie.length);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    job.hash    = chip.hash();
+    job.seconds = elapsed.count();
+    job.ok      = true;
+}
+
+void print_usage(const char *progname) {
+    std::fprintf(stderr, "Usage: %s [-b|-j|-a] [-t threads] [-i ipf] manifest\n", progname);
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    auto mode = c8::Chip8::Mode::Interpreter;
+    std::size_t threads = std::thread::hardware_concurrency();
+    std::uint32_t ipf = c8::sched::default_ipf;
+
+    static const struct option long_options[] = {
+        { "block",   no_argument,       nullptr, 'b' },
+        { "jit",     no_argument,       nullptr, 'j' },
+        { "aot",     no_argument,       nullptr, 'a' },
+        { "threads", required_argument, nullptr, 't' },
+        { "ipf",     required_argument, nullptr, 'i' },
+        { nullptr,   0,                 nullptr, 0   },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "bjat:i:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'b':
+                mode = c8::Chip8::Mode::Block;
+                break;
+            case 'j':
+                mode = c8::Chip8::Mode::Jit;
+                break;
+            case 'a':
+                mode = c8::Chip8::Mode::Aot;
+                break;
+            case 't':
+                threads = std::strtoul(optarg, nullptr, 0);
+                break;
+            case 'i':
+                ipf = std::strtoul(optarg, nullptr, 0);
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc)
+        print_usage(argv[0]);
+
+    std::vector<Job> jobs;
+    if (!load_manifest(argv[optind], jobs))
+        return EXIT_FAILURE;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        c8::pool::Pool pool(threads);
+        for (auto &job: jobs)
+            pool.submit([&job, mode, ipf] { run(job, mode, ipf); });
+        pool.wait();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Jobs only write to their own slot, print in manifest order once everything is done
+    int rc = EXIT_SUCCESS;
+    std::uint64_t total = 0;
+    for (auto &job: jobs) {
+        if (!job.ok) {
+            std::printf("%s %s %" PRIu64 " failed\n", job.rom.c_str(), job.script.c_str(), job.budget);
+            rc = EXIT_FAILURE;
+            continue;
+        }
+
+        std::printf("%s %s %" PRIu64 " %016" PRIx64 " %" PRIu64 " %.6fs %.2f MIPS\n",
+            job.rom.c_str(), job.script.c_str(), job.budget, job.hash, job.executed,
+            job.seconds, job.executed / job.seconds / 1e6);
+        total += job.executed;
+    }
+
+    std::printf("%zu jobs, %" PRIu64 " instructions in %.3fs (%.2f MIPS)\n",
+        jobs.size(), total, elapsed.count(), total / elapsed.count() / 1e6);
+
+    return rc;
+}
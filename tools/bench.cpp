@@ -0,0 +1,491 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "chip8.hpp"
+#include "jit.hpp"
+#include "rewind.hpp"
+#include "rom.hpp"
+#include "script.hpp"
+#include "window.hpp"
+
+// Counts every heap allocation made by the process
+namespace {
+
+std::atomic<std::uint64_t> allocations = 0;
+
+} // namespace
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    ++allocations;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size) {
+    if (auto *ptr = operator new(size, std::nothrow); ptr)
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+using Clock   = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+struct Mode {
+    const char      *name;
+    c8::Chip8::Mode  mode;
+};
+
+constexpr Mode modes[] = {
+    { "interpreter", c8::Chip8::Mode::Interpreter },
+    { "block",       c8::Chip8::Mode::Block       },
+    { "jit",         c8::Chip8::Mode::Jit         },
+};
+
+struct Result {
+    std::string   rom;
+    const char   *mode;
+    std::uint64_t executed = 0, allocations = 0;
+    double        seconds = 0;
+};
+
+struct ForkResult {
+    std::string rom;
+    bool        agrees = false;   // Parent and child reached the same state
+    double      per_second = 0;
+    std::size_t owned_pages = 0;  // Memory pages the child had to copy
+};
+
+struct ReplayResult {
+    std::string rom;
+    bool        agrees = false; // Every mode replayed the recording to the recorded state
+    std::size_t events = 0;
+};
+
+struct SpriteResult {
+    bool   agrees = false; // Same pixels and collisions as the per-pixel drawing
+    double row_per_second = 0, pixel_per_second = 0;
+};
+
+// A key every 1000 instructions, cycling through the keypad, so menus get past and games move
+c8::script::Script make_script(std::uint64_t budget) {
+    c8::script::Script script;
+    for (std::uint64_t cycle = 1000; cycle < budget; cycle += 1000)
+        script.push_back({ cycle, static_cast<c8::win::Key>((cycle / 1000) % c8::win::KeyInvalid) });
+    return script;
+}
+
+// Best of repeats, the machine is rebuilt every time so caches start cold
+bool run_rom(Result &result, const std::shared_ptr<const c8::rom::Program> &program, const Mode &mode,
+        const c8::script::Script &script, std::uint64_t budget, int repeats) {
+    for (int i = 0; i < repeats; ++i) {
+        auto chip = c8::Chip8(program, mode.mode, true);
+        chip.seed(0);
+
+        auto before = allocations.load();
+        auto start  = Clock::now();
+        auto executed = c8::script::run(chip, script, budget);
+        Seconds elapsed = Clock::now() - start;
+
+        if ((i == 0) || (elapsed.count() < result.seconds)) {
+            result.executed    = executed;
+            result.seconds     = elapsed.count();
+            result.allocations = allocations - before;
+        }
+    }
+    return result.executed;
+}
+
+// Forks a family of children halfway through the run, then feeds the parent and one child the
+// rest of the script: both must end in the same state, with the child owning only what it wrote
+ForkResult check_fork(const std::string &rom, const std::shared_ptr<const c8::rom::Program> &program,
+        const c8::script::Script &script, std::uint64_t budget) {
+    constexpr int children = 1000;
+
+    auto parent = c8::Chip8(program, c8::Chip8::Mode::Interpreter, true);
+    parent.seed(0);
+    c8::script::run(parent, script, budget / 2);
+
+    // Events are keyed on absolute cycles, only pass those still ahead
+    c8::script::Script rest;
+    std::copy_if(script.begin(), script.end(), std::back_inserter(rest),
+        [&](auto &event) { return event.cycle >= parent.scheduler.cycles; });
+
+    std::vector<std::unique_ptr<c8::Chip8>> family;
+    family.reserve(children);
+    auto start = Clock::now();
+    for (int i = 0; i < children; ++i)
+        family.push_back(parent.fork());
+    Seconds elapsed = Clock::now() - start;
+
+    auto &child = *family.front();
+    c8::script::run(parent, rest, budget - budget / 2);
+    c8::script::run(child,  rest, budget - budget / 2);
+    return { rom, parent.hash() == child.hash(), children / elapsed.count(), child.ram.owned_pages() };
+}
+
+// Delivers keys from update(), where a player at the terminal would, and keeps asking for a
+// state load and a rewind, which must not make it into the recording
+class Keyboard: public c8::win::Window {
+    public:
+        Keyboard(const c8::sched::Scheduler &scheduler, const c8::script::Script &script):
+            scheduler(scheduler), script(script), next(script.begin()) { }
+
+        void update() override {
+            for (; (this->next != this->script.end()) && (this->next->cycle <= this->scheduler.cycles); ++this->next)
+                this->press(this->next->key);
+            // Spread out so the session still moves forward when they are honoured
+            ++this->frames;
+            this->should_save   |= !(this->frames % c8::sched::frame_rate);
+            this->should_load   |= (this->frames % c8::sched::frame_rate) == c8::sched::frame_rate / 2;
+            this->should_rewind |= (this->frames % (2 * c8::sched::frame_rate)) == c8::sched::frame_rate / 4;
+        }
+
+    protected:
+        const c8::sched::Scheduler         &scheduler;
+        const c8::script::Script           &script;
+        c8::script::Script::const_iterator  next;
+        std::uint64_t                       frames = 0;
+};
+
+// Records a session played through the window, then replays the movie in every mode
+ReplayResult check_replay(const std::string &rom, const std::shared_ptr<const c8::rom::Program> &program,
+        const c8::script::Script &script, std::uint64_t budget) {
+    char path[] = "/tmp/c8-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return { rom };
+    close(fd);
+
+    auto chip = c8::Chip8(program, c8::Chip8::Mode::Interpreter, true);
+    chip.seed(0);
+    chip.window        = std::make_unique<Keyboard>(chip.scheduler, script);
+    chip.snapshot_path = path;
+    chip.history       = std::make_unique<c8::rwd::History>(c8::sched::frame_rate);
+    chip.movie         = std::make_unique<c8::script::Movie>();
+    chip.movie->seed   = chip.get_seed();
+    c8::script::run(chip, {}, budget);
+    chip.movie->length = chip.scheduler.cycles;
+    unlink(path);
+
+    ReplayResult result{ rom, true, chip.movie->script.size() };
+    for (auto &mode: modes) {
+        if ((mode.mode == c8::Chip8::Mode::Jit) && !c8::jit::available)
+            continue;
+
+        auto replay = c8::Chip8(program, mode.mode, true);
+        replay.seed(chip.movie->seed);
+        c8::script::run(replay, chip.movie->script, chip.movie->length);
+        result.agrees &= replay.hash() == chip.hash();
+    }
+    return result;
+}
+
+// Full Dxyn through its handler: gathering, XOR and collision, over every position and height
+double bench_dxyn(std::uint64_t count) {
+    auto chip = c8::Chip8(std::make_shared<c8::rom::Program>(std::vector<std::uint8_t>(2)), c8::Chip8::Mode::Interpreter, true);
+    auto *drw = c8::ins::handler(c8::ins::Kind::Drw);
+
+    auto start = Clock::now();
+    for (std::uint64_t i = 0; i < count; ++i) {
+        chip.regs.V0 = i;
+        chip.regs.V1 = i >> 6;
+        chip.regs.I  = (i * 5) & 0xff;
+        drw(chip, c8::ins::Opcode(0xd010 | ((i % c8::win::max_sprite_height) + 1)));
+    }
+    Seconds elapsed = Clock::now() - start;
+    return count / elapsed.count();
+}
+
+// The drawing rows replaced: one byte per pixel, both coordinates wrapped for each of them
+struct PixelScreen {
+    std::array<std::uint8_t, c8::win::width * c8::win::height> buf{};
+
+    bool apply_sprite(const std::uint8_t *sprite, std::size_t rows, std::uint8_t x, std::uint8_t y) {
+        bool collision = false;
+        for (std::size_t sprite_y = 0; sprite_y < rows; ++sprite_y) {
+            for (std::uint8_t sprite_x = 0; sprite_x < 8; ++sprite_x) {
+                auto &old_px = this->buf[c8::win::width * ((y + sprite_y) % c8::win::height) + (x + sprite_x) % c8::win::width];
+                auto  new_px = !!(sprite[sprite_y] & (1 << (7 - sprite_x)));
+                collision |= old_px && new_px;
+                old_px    ^= new_px;
+            }
+        }
+        return collision;
+    }
+};
+
+struct Draw {
+    std::array<std::uint8_t, c8::win::max_sprite_height> sprite;
+    std::uint8_t rows, x, y;
+};
+
+// Random sprites at random positions, coordinates over the whole register range so they wrap.
+// Checks every draw against the per-pixel drawing, then times both over count draws
+SpriteResult check_sprites(std::uint64_t count) {
+    std::vector<Draw> draws(1 << 16);
+    std::mt19937 rng(0);
+    for (auto &draw: draws) {
+        for (auto &row: draw.sprite)
+            row = rng();
+        draw.rows = rng() % (c8::win::max_sprite_height + 1);
+        draw.x    = rng();
+        draw.y    = rng();
+    }
+
+    SpriteResult result;
+    result.agrees = true;
+    {
+        c8::win::Headless window;
+        PixelScreen screen;
+        for (auto &draw: draws) {
+            result.agrees &= window.apply_sprite(draw.sprite.data(), draw.rows, draw.x, draw.y)
+                == screen.apply_sprite(draw.sprite.data(), draw.rows, draw.x, draw.y);
+            for (std::uint8_t y = 0; y < c8::win::height; ++y) {
+                for (std::uint8_t x = 0; x < c8::win::width; ++x)
+                    result.agrees &= window.pixel(x, y) == screen.buf[c8::win::width * y + x];
+            }
+        }
+    }
+
+    auto time = [&](auto &target) {
+        bool sink = false;
+        auto start = Clock::now();
+        for (std::uint64_t i = 0; i < count; ++i) {
+            auto &draw = draws[i % draws.size()];
+            sink ^= target.apply_sprite(draw.sprite.data(), draw.rows, draw.x, draw.y);
+        }
+        Seconds elapsed = Clock::now() - start;
+        asm volatile("" :: "r"(sink));
+        return count / elapsed.count();
+    };
+    c8::win::Headless window;
+    PixelScreen screen;
+    result.row_per_second   = time(window);
+    result.pixel_per_second = time(screen);
+    return result;
+}
+
+// Every opcode through ins::decode
+double bench_decode(int rounds) {
+    unsigned int sink = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        for (std::uint32_t op = 0; op <= UINT16_MAX; ++op) {
+            auto opaque = op;
+            asm volatile("" : "+r"(opaque)); // Keep the compiler from folding the table
+            sink += static_cast<unsigned int>(c8::ins::decode(c8::ins::Opcode(opaque)));
+        }
+    }
+    Seconds elapsed = Clock::now() - start;
+    asm volatile("" :: "r"(sink));
+    return rounds * (UINT16_MAX + 1.0) / elapsed.count();
+}
+
+// Quoted, with the characters JSON reserves escaped
+void write_string(std::FILE *fp, const std::string &str) {
+    std::fputc('"', fp);
+    for (unsigned char chr: str) {
+        if ((chr == '"') || (chr == '\\'))
+            std::fprintf(fp, "\\%c", chr);
+        else if (chr < 0x20)
+            std::fprintf(fp, "\\u%04x", chr);
+        else
+            std::fputc(chr, fp);
+    }
+    std::fputc('"', fp);
+}
+
+// Ratios of empty runs have no value, JSON has no inf nor nan
+void write_number(std::FILE *fp, double value, int precision) {
+    if (std::isfinite(value))
+        std::fprintf(fp, "%.*f", precision, value);
+    else
+        std::fputs("null", fp);
+}
+
+void write_json(std::FILE *fp, const std::vector<Result> &results, const std::vector<ForkResult> &forks,
+        const std::vector<ReplayResult> &replays,
+        const SpriteResult &sprites, std::uint64_t budget, double dxyn, double decode) {
+    std::fprintf(fp, "{\n  \"budget\": %" PRIu64 ",\n  \"dxyn_per_second\": ", budget);
+    write_number(fp, dxyn, 0);
+    std::fprintf(fp, ",\n  \"decodes_per_second\": ");
+    write_number(fp, decode, 0);
+    std::fprintf(fp, ",\n  \"sprites\": { \"agrees\": %s, \"rows_per_second\": ", sprites.agrees ? "true" : "false");
+    write_number(fp, sprites.row_per_second, 0);
+    std::fprintf(fp, ", \"pixels_per_second\": ");
+    write_number(fp, sprites.pixel_per_second, 0);
+    std::fprintf(fp, " }");
+    std::fprintf(fp, ",\n  \"roms\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        auto &r = results[i];
+        std::fprintf(fp, "    { \"rom\": ");
+        write_string(fp, r.rom);
+        std::fprintf(fp, ", \"mode\": \"%s\", \"instructions\": %" PRIu64 ", \"seconds\": %.6f, \"mips\": ",
+            r.mode, r.executed, r.seconds);
+        write_number(fp, r.executed / r.seconds / 1e6, 3);
+        std::fprintf(fp, ", \"ns_per_instruction\": ");
+        write_number(fp, r.seconds * 1e9 / r.executed, 3);
+        std::fprintf(fp, ", \"allocations_per_instruction\": ");
+        write_number(fp, double(r.allocations) / r.executed, 6);
+        std::fprintf(fp, " }%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    std::fprintf(fp, "  ],\n  \"forks\": [\n");
+    for (std::size_t i = 0; i < forks.size(); ++i) {
+        auto &f = forks[i];
+        std::fprintf(fp, "    { \"rom\": ");
+        write_string(fp, f.rom);
+        std::fprintf(fp, ", \"agrees\": %s, \"forks_per_second\": ", f.agrees ? "true" : "false");
+        write_number(fp, f.per_second, 0);
+        std::fprintf(fp, ", \"owned_pages\": %zu }%s\n", f.owned_pages, (i + 1 < forks.size()) ? "," : "");
+    }
+    std::fprintf(fp, "  ],\n  \"replays\": [\n");
+    for (std::size_t i = 0; i < replays.size(); ++i) {
+        auto &r = replays[i];
+        std::fprintf(fp, "    { \"rom\": ");
+        write_string(fp, r.rom);
+        std::fprintf(fp, ", \"agrees\": %s, \"events\": %zu }%s\n", r.agrees ? "true" : "false", r.events,
+            (i + 1 < replays.size()) ? "," : "");
+    }
+    std::fprintf(fp, "  ]\n}\n");
+}
+
+void print_usage(const char *progname) {
+    std::fprintf(stderr, "Usage: %s [-n instructions] [-r repeats] [-o out.json] rom...\n", progname);
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::uint64_t budget = 5'000'000;
+    int repeats = 3;
+    const char *json_path = nullptr;
+
+    static const struct option long_options[] = {
+        { "budget",  required_argument, nullptr, 'n' },
+        { "repeats", required_argument, nullptr, 'r' },
+        { "output",  required_argument, nullptr, 'o' },
+        { nullptr,   0,                 nullptr, 0   },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:r:o:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 'n':
+                budget = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 'r':
+                repeats = std::max(1, std::atoi(optarg));
+                break;
+            case 'o':
+                json_path = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
+
+    if ((optind >= argc) || !budget)
+        print_usage(argv[0]);
+
+    auto script = make_script(budget);
+    std::vector<Result> results;
+    std::vector<ForkResult> forks;
+    std::vector<ReplayResult> replays;
+    int rc = EXIT_SUCCESS;
+    for (int i = optind; i < argc; ++i) {
+        auto rom = c8::rom::Rom(argv[i]);
+        if (rom.empty()) {
+            std::fprintf(stderr, "Failed to load rom %s\n", argv[i]);
+            rc = EXIT_FAILURE;
+            continue;
+        }
+
+        for (auto &mode: modes) {
+            if ((mode.mode == c8::Chip8::Mode::Jit) && !c8::jit::available)
+                continue;
+
+            auto &result = results.emplace_back(Result{ argv[i], mode.name });
+            run_rom(result, rom.get_code(), mode, script, budget, repeats);
+            std::printf("%-24s %-11s %8.2f MIPS %7.2f ns/ins %.4f allocs/ins\n", argv[i], mode.name,
+                result.executed / result.seconds / 1e6, result.seconds * 1e9 / result.executed,
+                double(result.allocations) / result.executed);
+        }
+
+        auto &fork = forks.emplace_back(check_fork(argv[i], rom.get_code(), script, budget));
+        std::printf("%-24s %-11s %8.2f K/s %s, child owns %zu pages\n", argv[i], "fork",
+            fork.per_second / 1e3, fork.agrees ? "agrees" : "DIVERGED", fork.owned_pages);
+        if (!fork.agrees)
+            rc = EXIT_FAILURE;
+
+        auto &replay = replays.emplace_back(check_replay(argv[i], rom.get_code(), script, budget));
+        std::printf("%-24s %-11s %zu keys %s\n", argv[i], "replay", replay.events,
+            replay.agrees ? "agrees" : "DIVERGED");
+        if (!replay.agrees)
+            rc = EXIT_FAILURE;
+    }
+
+    auto dxyn   = bench_dxyn(budget);
+    auto decode = bench_decode(std::max<std::uint64_t>(budget >> 16, 1));
+    std::printf("Dxyn: %.2f M/s, decode: %.2f M/s\n", dxyn / 1e6, decode / 1e6);
+
+    auto sprites = check_sprites(budget);
+    std::printf("Sprites: %.2f M/s by rows, %.2f M/s by pixels, %s\n", sprites.row_per_second / 1e6,
+        sprites.pixel_per_second / 1e6, sprites.agrees ? "agree" : "DIFFER");
+    if (!sprites.agrees)
+        rc = EXIT_FAILURE;
+
+    if (json_path) {
+        auto *fp = std::fopen(json_path, "w");
+        if (!fp) {
+            std::fprintf(stderr, "Failed to open %s\n", json_path);
+            return EXIT_FAILURE;
+        }
+        write_json(fp, results, forks, replays, sprites, budget, dxyn, decode);
+        if (std::fclose(fp))
+            rc = EXIT_FAILURE;
+    }
+
+    return rc;
+}
@@ -0,0 +1,118 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+
+#include "chip8.hpp"
+#include "disasm.hpp"
+#include "pool.hpp"
+#include "rom.hpp"
+
+namespace {
+
+struct Job {
+    const char *path;
+
+    // Results
+    bool        ok = false;
+    std::string listing;
+};
+
+void run(Job &job) {
+    auto rom = c8::rom::Rom(job.path);
+    if (rom.empty())
+        return;
+
+    c8::Ram ram{};
+    c8::Chip8::load(ram, *rom.get_code());
+
+    // Each listing goes to memory, printed whole once every job is done
+    char *buf = nullptr;
+    std::size_t size = 0;
+    auto *fp = open_memstream(&buf, &size);
+    if (!fp)
+        return;
+    job.ok = c8::dis::disassemble(fp, ram.data(), rom.get_code()->size());
+    job.ok &= !std::fclose(fp);
+    job.listing.assign(buf, size);
+    std::free(buf);
+}
+
+void print_usage(const char *progname) {
+    std::fprintf(stderr, "Usage: %s [-t threads] rom...\n", progname);
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::size_t threads = std::thread::hardware_concurrency();
+
+    static const struct option long_options[] = {
+        { "threads", required_argument, nullptr, 't' },
+        { nullptr,   0,                 nullptr, 0   },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 't':
+                threads = std::strtoul(optarg, nullptr, 0);
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc)
+        print_usage(argv[0]);
+
+    std::vector<Job> jobs;
+    for (int i = optind; i < argc; ++i)
+        jobs.push_back({ argv[i], false, {} });
+
+    {
+        c8::pool::Pool pool(threads);
+        for (auto &job: jobs)
+            pool.submit([&job] { run(job); });
+        pool.wait();
+    }
+
+    // Listings in argument order, through one big buffer
+    static char out[1 << 20];
+    std::setvbuf(stdout, out, _IOFBF, sizeof(out));
+
+    int rc = EXIT_SUCCESS;
+    for (auto &job: jobs) {
+        if (!job.ok) {
+            std::fprintf(stderr, "Failed to disassemble %s\n", job.path);
+            rc = EXIT_FAILURE;
+            continue;
+        }
+
+        std::printf("%s:\n", job.path);
+        std::fwrite(job.listing.data(), 1, job.listing.size(), stdout);
+        std::printf("\n");
+    }
+
+    return rc;
+}
@@ -0,0 +1,113 @@
+// Copyright (C) 2020 averne
+//
+// This file is part of c8.
+//
+// c8 is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// c8 is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with c8.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+
+#include "chip8.hpp"
+#include "trace.hpp"
+
+namespace {
+
+void print_usage(const char *progname) {
+    std::fprintf(stderr, "Usage: %s [-s skip] [-n count] trace\n", progname);
+    std::exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::uint64_t skip = 0, count = UINT64_MAX;
+
+    static const struct option long_options[] = {
+        { "skip",  required_argument, nullptr, 's' },
+        { "count", required_argument, nullptr, 'n' },
+        { nullptr, 0,                 nullptr, 0   },
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:n:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's':
+                skip = std::strtoull(optarg, nullptr, 0);
+                break;
+            case 'n':
+                count = std::strtoull(optarg, nullptr, 0);
+                break;
+            default:
+                print_usage(argv[0]);
+        }
+    }
+
+    if (optind >= argc)
+        print_usage(argv[0]);
+
+    auto *fp = std::fopen(argv[optind], "rb");
+    if (!fp) {
+        std::fprintf(stderr, "Failed to open %s\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    c8::trace::Header header;
+    if ((std::fread(&header, sizeof(header), 1, fp) != 1) || (header.magic != c8::trace::magic)
+            || (header.version != c8::trace::version) || (header.record_size != sizeof(c8::trace::Record))) {
+        std::fprintf(stderr, "%s is not a compatible trace\n", argv[optind]);
+        std::fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    // Output is large, print through a big buffer
+    static char out[1 << 20];
+    std::setvbuf(stdout, out, _IOFBF, sizeof(out));
+    std::setvbuf(fp, nullptr, _IOFBF, c8::trace::Writer::chunk_size * sizeof(c8::trace::Record));
+
+    // Records only keep the low bits of the cycle, widen them back assuming it only grows.
+    // Payloads make records uneven, skipping reads through them
+    auto cycle = header.start_cycle;
+    c8::trace::Record r;
+    c8::trace::Payload payload;
+    for (std::uint64_t n = 0; ((n < skip) || (n - skip < count)) && (std::fread(&r, sizeof(r), 1, fp) == 1); ++n) {
+        auto widened = (cycle & ~std::uint64_t(UINT32_MAX)) | r.cycle;
+        cycle = (widened < cycle) ? widened + (std::uint64_t(1) << 32) : widened;
+
+        auto op    = c8::ins::Opcode(r.op);
+        auto moved = c8::trace::moved(c8::ins::decode(op), op);
+        if (moved && (std::fread(&payload, sizeof(payload), 1, fp) != 1))
+            break;
+        if (n < skip)
+            continue;
+
+        std::printf("%12" PRIu64 " %03x: %04x  V%x=%02x Vf=%02x I=%03x DT=%02x", cycle, r.pc, r.op,
+            op.x(), r.vx, r.vf, r.i, r.dt);
+        if (moved) {
+            if (r.written)
+                std::printf(" [%03x..%03x] =", r.addr, (r.addr + r.written - 1) & c8::address_mask);
+            else
+                std::printf(" V0..V%x =", op.x());
+            for (int i = 0; i < moved; ++i)
+                std::printf(" %02x", payload.bytes[i]);
+        }
+        std::printf("  ");
+        c8::ins::print(op);
+    }
+
+    std::fclose(fp);
+    return EXIT_SUCCESS;
+}